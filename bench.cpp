@@ -0,0 +1,195 @@
+// bench.cpp
+#include "event.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using TimeMs = es::TimeMs;
+using EventType = es::EventType;
+
+constexpr es::SchedulerTraits kMinimalTraits{.priorities = false, .exceptions = false, .catchup = false, .pause = false,
+                                          .slack = false};
+
+using FullScheduler = es::EventScheduler<>;
+using MinimalScheduler = es::EventScheduler<es::DefaultCallback, kMinimalTraits>;
+using BucketScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.bucketing = true}>;
+using BatchScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.batch_run = true}>;
+using TieredScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.tier_horizon = 64}>;
+using SnapshotScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.snapshots = true}>;
+using CowScheduler = es::CowEventScheduler<>;
+using KeyedScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.keyed = true}>;
+
+static volatile uint64_t g_sink = 0;
+
+struct Clock {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed_ns() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// 大量 Once 事件：随机时刻 schedule，然后每次 tick 1ms 直到全部触发
+template <typename S> static double bench_once(size_t n, TimeMs horizon) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<TimeMs> dist(0, horizon - 1);
+    S s;
+    Clock c;
+    for (size_t i = 0; i < n; ++i) s.schedule(dist(rng), [] { g_sink = g_sink + 1; });
+    for (TimeMs t = 0; t < horizon; ++t) s.tick(1);
+    return c.elapsed_ns() / static_cast<double>(n);
+}
+
+// Repeat 事件：周期随机，统计每次触发的开销
+template <typename S> static double bench_repeat(size_t n, TimeMs duration) {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<TimeMs> dist(1, 100);
+    S s;
+    for (size_t i = 0; i < n; ++i) {
+        TimeMs interval = dist(rng);
+        s.schedule(interval, [] { g_sink = g_sink + 1; }, es::TimeMode::Relative, EventType::Repeat, interval);
+    }
+    uint64_t before = g_sink;
+    Clock c;
+    for (TimeMs t = 0; t < duration; ++t) s.tick(1);
+    double ns = c.elapsed_ns();
+    return ns / static_cast<double>(g_sink - before);
+}
+
+// schedule 后立即 cancel 一半，测试 cancel 和回收的开销
+template <typename S> static double bench_churn(size_t n) {
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<TimeMs> dist(1, 1000);
+    S s;
+    std::vector<es::EventID> ids;
+    ids.reserve(n);
+    Clock c;
+    for (size_t i = 0; i < n; ++i) {
+        ids.push_back(s.schedule(dist(rng), [] { g_sink = g_sink + 1; }));
+        if (i % 2 == 1) s.cancel(ids[i - 1]);
+        if (i % 1024 == 0) s.tick(1);
+    }
+    s.tick(1000);
+    return c.elapsed_ns() / static_cast<double>(n);
+}
+
+// 离线模拟：预先加载全部事件后 run()
+template <typename S> static double bench_run(size_t n, TimeMs horizon) {
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<TimeMs> dist(0, horizon - 1);
+    S s;
+    for (size_t i = 0; i < n; ++i) s.schedule(dist(rng), [] { g_sink = g_sink + 1; });
+    Clock c;
+    s.run();
+    return c.elapsed_ns() / static_cast<double>(n);
+}
+
+// 回滚：n 个远期事件不动，每帧 schedule / cancel 少量事件并 tick，每 8 帧回滚到 8 帧之前，统计每次回滚的开销
+static double bench_rollback(size_t n, size_t rounds) {
+    SnapshotScheduler s;
+    for (size_t i = 0; i < n; ++i) s.schedule(1'000'000 + static_cast<TimeMs>(i), [] { g_sink = g_sink + 1; });
+    std::vector<es::EventID> ids;
+    double ns = 0;
+    for (size_t r = 0; r < rounds; ++r) {
+        SnapshotScheduler::StateId first = s.save_state();
+        for (int frame = 0; frame < 8; ++frame) {
+            if (frame > 0) s.save_state();
+            for (int k = 0; k < 8; ++k) ids.push_back(s.schedule(k * 5, [] { g_sink = g_sink + 1; }));
+            s.cancel(ids[ids.size() - 3]);
+            s.tick(16);
+        }
+        Clock c;
+        s.restore_state(first);
+        ns += c.elapsed_ns();
+        s.release_states_before(first + 1);
+        ids.clear();
+    }
+    return ns / static_cast<double>(rounds);
+}
+
+// 推演：n 个事件的调度器每次 fork 一份，在分支上 schedule / cancel 少量事件并 tick 一帧，统计每个分支的开销
+template <typename S> static double bench_fork(size_t n, size_t branches) {
+    std::mt19937 rng(19);
+    std::uniform_int_distribution<TimeMs> dist(0, 1'000'000);
+    S s;
+    std::vector<es::EventID> ids;
+    for (size_t i = 0; i < n; ++i) ids.push_back(s.schedule(dist(rng), [] { g_sink = g_sink + 1; }));
+    Clock c;
+    for (size_t b = 0; b < branches; ++b) {
+        S f = s.fork();
+        for (int k = 0; k < 8; ++k) f.schedule(k, [] { g_sink = g_sink + 1; });
+        f.cancel(ids[b * 7919 % n]);
+        f.tick(16);
+    }
+    return c.elapsed_ns() / static_cast<double>(branches);
+}
+
+// 按 key 反复替换定时器（防抖）：外部 unordered_map<key, EventID> 与内置索引对比
+static double bench_keyed_manual(size_t keys, size_t ops) {
+    std::mt19937 rng(29);
+    std::uniform_int_distribution<uint64_t> dist(0, keys - 1);
+    FullScheduler s;
+    std::unordered_map<uint64_t, es::EventID> ids;
+    Clock c;
+    for (size_t i = 0; i < ops; ++i) {
+        uint64_t key = dist(rng);
+        auto it = ids.find(key);
+        if (it != ids.end()) s.cancel(it->second);
+        ids[key] = s.schedule(50, [] { g_sink = g_sink + 1; });
+        if (i % 64 == 0) s.tick(1);
+    }
+    return c.elapsed_ns() / static_cast<double>(ops);
+}
+
+static double bench_keyed_native(size_t keys, size_t ops) {
+    std::mt19937 rng(29);
+    std::uniform_int_distribution<uint64_t> dist(0, keys - 1);
+    KeyedScheduler s;
+    Clock c;
+    for (size_t i = 0; i < ops; ++i) {
+        s.schedule_or_replace(dist(rng), 50, [] { g_sink = g_sink + 1; });
+        if (i % 64 == 0) s.tick(1);
+    }
+    return c.elapsed_ns() / static_cast<double>(ops);
+}
+
+// 日历表达式：连续求下一次匹配时刻
+static double bench_calendar(const char *expr, size_t n) {
+    es::CronExpr c = *es::CronExpr::parse(expr);
+    TimeMs t = 1'700'000'000'000;
+    Clock clk;
+    for (size_t i = 0; i < n; ++i) t = c.next_after(t);
+    g_sink = g_sink + static_cast<uint64_t>(t);
+    return clk.elapsed_ns() / static_cast<double>(n);
+}
+
+template <typename S> static void run_all(const char *name) {
+    std::printf("%-8s once   %8.1f ns/event\n", name, bench_once<S>(1'000'000, 10'000));
+    std::printf("%-8s repeat %8.1f ns/fire\n", name, bench_repeat<S>(10'000, 10'000));
+    std::printf("%-8s churn  %8.1f ns/event\n", name, bench_churn<S>(1'000'000));
+}
+
+int main() {
+    std::printf("sizeof(EventDesc): full %zu, minimal %zu\n", sizeof(es::EventDesc<>),
+                sizeof(es::EventDesc<es::DefaultCallback, kMinimalTraits>));
+    run_all<FullScheduler>("full");
+    run_all<MinimalScheduler>("minimal");
+    run_all<BucketScheduler>("bucket");
+    run_all<TieredScheduler>("tiered");
+    run_all<CowScheduler>("cow");
+    std::printf("full     run    %8.1f ns/event\n", bench_run<FullScheduler>(1'000'000, 1'000'000));
+    std::printf("batch    run    %8.1f ns/event\n", bench_run<BatchScheduler>(1'000'000, 1'000'000));
+    std::printf("snapshot rollback 8 frames, 1M events %8.1f ns\n", bench_rollback(1'000'000, 1000));
+    std::printf("full     fork 1M events %10.1f ns/branch\n", bench_fork<FullScheduler>(1'000'000, 20));
+    std::printf("cow      fork 1M events %10.1f ns/branch\n", bench_fork<CowScheduler>(1'000'000, 20));
+    std::printf("manual   keyed replace %8.1f ns/op\n", bench_keyed_manual(100'000, 2'000'000));
+    std::printf("native   keyed replace %8.1f ns/op\n", bench_keyed_native(100'000, 2'000'000));
+    std::printf("cron     */5 * * * *    %8.1f ns/next\n", bench_calendar("*/5 * * * *", 1'000'000));
+    std::printf("cron     0 9 * * 1-5    %8.1f ns/next\n", bench_calendar("0 9 * * 1-5", 1'000'000));
+    std::printf("cron     0 0 29 2 *     %8.1f ns/next\n", bench_calendar("0 0 29 2 *", 100'000));
+    return 0;
+}
@@ -0,0 +1,209 @@
+// cron.hpp
+#pragma once
+#include "event.hpp"
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace es {
+
+// 预编译的 cron 表达式："分 时 日 月 周"，每个字段支持 *、a、a-b、*/n、a-b/n、a/n 以及逗号分隔的列表，周的 0 和 7
+// 都是周日。与 Vixie cron 相同，日和周都不以 * 开头时满足任一即可，否则两者都要满足。每个字段编译成位图，next_after
+// 逐字段用位扫描跳到下一个候选值，不会逐分钟迭代。时间是 Unix 毫秒，utc_offset_ms 为固定的时区偏移（东八区为 +8h），不处理夏令时
+class CronExpr {
+public:
+    static std::optional<CronExpr> parse(std::string_view expr, TimeMs utc_offset_ms = 0) {
+        CronExpr c;
+        c.offset = utc_offset_ms;
+        uint64_t bits[5]{};
+        bool star[5]{};
+        for (int i = 0; i < 5; ++i) {
+            while (!expr.empty() && expr.front() == ' ') expr.remove_prefix(1);
+            size_t end = expr.find(' ');
+            std::string_view field = expr.substr(0, end);
+            expr = end == std::string_view::npos ? std::string_view{} : expr.substr(end);
+            if (field.empty() || !parse_field(field, fields[i].lo, fields[i].hi, bits[i])) return std::nullopt;
+            star[i] = field.front() == '*';
+        }
+        while (!expr.empty() && expr.front() == ' ') expr.remove_prefix(1);
+        if (!expr.empty()) return std::nullopt;
+
+        c.minutes = bits[0];
+        c.hours = static_cast<uint32_t>(bits[1]);
+        c.days = static_cast<uint32_t>(bits[2]);
+        c.months = static_cast<uint16_t>(bits[3]);
+        c.weekdays = static_cast<uint8_t>((bits[4] | bits[4] >> 7) & 0x7F); // 7 也是周日
+        c.day_star = star[2];
+        c.weekday_star = star[4];
+        // 日和周都要满足时，至少有一个选中的月份能取到选中的日，否则 next_after 找不到结果。每个日期在不同年份会落在
+        // 每一个星期几上，所以只需要检查日
+        if (c.day_star || c.weekday_star) {
+            bool feasible = false;
+            for (unsigned m = 1; m <= 12; ++m)
+                if ((c.months >> m & 1) && (c.days & day_bits(m == 2 ? 29 : days_in_month(1, m)))) feasible = true;
+            if (!feasible) return std::nullopt;
+        }
+        return c;
+    }
+
+    // 严格晚于 t 的下一个匹配时刻（整分钟）
+    TimeMs next_after(TimeMs t) const noexcept {
+        int64_t minute = floor_div(t + offset, 60'000) + 1;
+        int64_t z = floor_div(minute, 1440);
+        int64_t rem = minute - z * 1440;
+        unsigned h = static_cast<unsigned>(rem / 60), mi = static_cast<unsigned>(rem % 60);
+        auto [y, mo, d] = civil_from_days(z);
+        for (;;) {
+            if (!(months >> mo & 1)) {
+                uint32_t later = static_cast<uint32_t>(months) >> mo;
+                if (later == 0) {
+                    ++y;
+                    mo = static_cast<unsigned>(std::countr_zero(months));
+                } else {
+                    mo += static_cast<unsigned>(std::countr_zero(later));
+                }
+                d = 1, h = 0, mi = 0;
+                continue;
+            }
+            uint64_t day_later = day_mask(y, mo) >> d;
+            if (day_later == 0) {
+                ++mo; // 13 在上面的月份检查中进入下一年
+                d = 1, h = 0, mi = 0;
+                continue;
+            }
+            if (unsigned nd = d + static_cast<unsigned>(std::countr_zero(day_later)); nd != d) d = nd, h = 0, mi = 0;
+            uint32_t hour_later = hours >> h;
+            if (hour_later == 0) {
+                ++d;
+                h = 0, mi = 0;
+                continue;
+            }
+            if (unsigned nh = h + static_cast<unsigned>(std::countr_zero(hour_later)); nh != h) h = nh, mi = 0;
+            uint64_t minute_later = minutes >> mi;
+            if (minute_later == 0) {
+                ++h;
+                mi = 0;
+                continue;
+            }
+            mi += static_cast<unsigned>(std::countr_zero(minute_later));
+            int64_t m = days_from_civil(y, mo, d) * 1440 + h * 60 + mi;
+            return m * 60'000 - offset;
+        }
+    }
+
+    friend bool operator==(const CronExpr &, const CronExpr &) noexcept = default;
+
+private:
+    struct Range {
+        unsigned lo, hi;
+    };
+    static constexpr Range fields[5] = {{0, 59}, {0, 23}, {1, 31}, {1, 12}, {0, 7}};
+
+    uint64_t minutes = 0;  // 第 i 位对应第 i 分钟
+    uint32_t hours = 0;    // 第 i 位对应 i 点
+    uint32_t days = 0;     // 第 d 位对应 d 日，第 0 位不用
+    uint16_t months = 0;   // 第 m 位对应 m 月，第 0 位不用
+    uint8_t weekdays = 0;  // 第 0 位为周日
+    bool day_star = true;  // 日 / 周字段以 * 开头，此时两者按“且”组合
+    bool weekday_star = true;
+    TimeMs offset = 0;
+
+    static bool parse_number(std::string_view &s, unsigned &v) {
+        if (s.empty() || s.front() < '0' || s.front() > '9') return false;
+        v = 0;
+        while (!s.empty() && s.front() >= '0' && s.front() <= '9') {
+            v = v * 10 + static_cast<unsigned>(s.front() - '0');
+            if (v > 1000) return false;
+            s.remove_prefix(1);
+        }
+        return true;
+    }
+
+    static bool parse_field(std::string_view field, unsigned lo, unsigned hi, uint64_t &bits) {
+        for (bool more = true; more;) {
+            size_t comma = field.find(',');
+            more = comma != std::string_view::npos;
+            std::string_view item = field.substr(0, comma);
+            if (more) field.remove_prefix(comma + 1);
+            if (item.empty()) return false;
+            unsigned a = lo, b = hi, step = 1;
+            if (item.front() == '*') {
+                item.remove_prefix(1);
+            } else {
+                if (!parse_number(item, a)) return false;
+                b = a;
+                if (!item.empty() && item.front() == '-') {
+                    item.remove_prefix(1);
+                    if (!parse_number(item, b)) return false;
+                } else if (!item.empty() && item.front() == '/') {
+                    b = hi; // a/n 等价于 a-hi/n
+                }
+            }
+            if (!item.empty() && item.front() == '/') {
+                item.remove_prefix(1);
+                if (!parse_number(item, step) || step == 0) return false;
+            }
+            if (!item.empty() || a < lo || b > hi || a > b) return false;
+            for (unsigned v = a; v <= b; v += step) bits |= uint64_t{1} << v;
+        }
+        return true;
+    }
+
+    static int64_t floor_div(int64_t a, int64_t b) noexcept {
+        int64_t q = a / b;
+        return a % b < 0 ? q - 1 : q;
+    }
+
+    static unsigned weekday(int64_t z) noexcept { // 1970-01-01 是周四
+        int64_t w = (z + 4) % 7;
+        return static_cast<unsigned>(w < 0 ? w + 7 : w);
+    }
+
+    static bool is_leap(int64_t y) noexcept { return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0); }
+    static unsigned days_in_month(int64_t y, unsigned m) noexcept {
+        constexpr unsigned dim[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        return m == 2 && is_leap(y) ? 29 : dim[m];
+    }
+    static uint64_t day_bits(unsigned dim) noexcept { return ((uint64_t{1} << dim) - 1) << 1; }
+
+    // 1970-01-01 起的天数与公历日期互相转换（H. Hinnant 的算法）
+    static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) noexcept {
+        y -= m <= 2;
+        int64_t era = floor_div(y, 400);
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+    struct Civil {
+        int64_t y;
+        unsigned m, d;
+    };
+    static Civil civil_from_days(int64_t z) noexcept {
+        z += 719468;
+        int64_t era = floor_div(z, 146097);
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        unsigned d = static_cast<unsigned>(doy - (153 * mp + 2) / 5 + 1);
+        unsigned m = static_cast<unsigned>(mp < 10 ? mp + 3 : mp - 9);
+        return {yoe + era * 400 + (m <= 2), m, d};
+    }
+
+    // y 年 mo 月中满足日 / 周字段的日期，第 d 位对应 d 日
+    uint64_t day_mask(int64_t y, unsigned mo) const noexcept {
+        uint64_t all = day_bits(days_in_month(y, mo));
+        uint64_t by_day = days;
+        bool both = day_star || weekday_star;
+        if (both && weekdays == 0x7F) return by_day & all;
+        // 1 日是周 w，把周的位图旋转到从 1 日开始，再按 7 天一周重复
+        unsigned w = weekday(days_from_civil(y, mo, 1));
+        uint64_t r = static_cast<uint64_t>((weekdays >> w) | (weekdays << (7 - w))) & 0x7F;
+        uint64_t by_weekday = (r | r << 7 | r << 14 | r << 21 | r << 28) << 1;
+        return (both ? by_day & by_weekday : by_day | by_weekday) & all;
+    }
+};
+
+} // namespace es
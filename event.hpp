@@ -1,7 +1,20 @@
 // event.hpp
 #pragma once
+#include "event_id.hpp"
+#include <compare>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#define ES_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define ES_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
 
 namespace es {
 
@@ -10,21 +23,160 @@ using TimeMs = int64_t;
 enum class EventType : uint8_t { Once, Repeat };
 enum class TimeMode : uint8_t { Relative, Absolute };
 enum class ExceptionPolicy : uint8_t { Swallow, Cancel, Rethrow };
-enum class EventPriority : uint8_t { System, User, Debug };
+// 常用优先级的别名，数值越小越先触发
+enum class EventPriority : uint8_t { System = 0, User = 128, Debug = 255 };
 enum class CatchUp : uint8_t {
     All,   // 触发中间经过的全部事件
     Latest // 只触发最后一次事件
 };
 
+// Repeat 事件触发后下一次触发时刻的计算方式
+enum class RepeatMode : uint8_t {
+    FixedRate,  // 上一次的预定时刻 + interval，落后时会补上错过的触发（见 CatchUp）
+    FixedDelay, // 回调结束时的调度器时间 + interval，落后时不会连续触发
+    Aligned,    // now() 之后的下一个 interval 整数倍时刻
+    Calendar    // now() 之后日历表达式的下一次匹配（见 EventScheduler::schedule_calendar），需要 SchedulerTraits::calendar
+};
+
+enum class JitterKind : uint8_t {
+    Uniform,    // [0, max_ms] 内均匀分布
+    Exponential // 均值为 mean_ms 的指数分布，截断到 max_ms
+};
+
+// FixedRate / FixedDelay 的 Repeat 事件每次重新调度时在周期之外追加的随机延迟，max_ms 为 0 时不追加。Aligned /
+// Calendar 事件保持对齐，不受 jitter 影响
+struct Jitter {
+    JitterKind kind = JitterKind::Uniform;
+    TimeMs max_ms = 0;
+    TimeMs mean_ms = 0; // 仅限 Exponential 使用
+    friend constexpr bool operator==(const Jitter &, const Jitter &) noexcept = default;
+};
+
+// 整数优先级，可以直接用 EventPriority 构造。可用的级数由调度器的 priority_bits 决定，位宽小于 8 时调度器把
+// EventPriority 的别名按比例缩放到可用的范围内
+struct Priority {
+    uint32_t level = static_cast<uint32_t>(EventPriority::User);
+    constexpr Priority() noexcept = default;
+    constexpr Priority(EventPriority p) noexcept : level(static_cast<uint32_t>(p)) {}
+    template <std::integral I> constexpr Priority(I l) noexcept : level(static_cast<uint32_t>(l)) {}
+    friend constexpr auto operator<=>(Priority, Priority) noexcept = default;
+};
+
+// 调度器的编译期配置。关闭的特性不占用 Event / EventDesc 的空间，相关分支在编译期去掉
+struct SchedulerTraits {
+    uint8_t priority_bits = 8;  // 优先级位宽，可用的优先级为 [0, 2^priority_bits)
+    bool priorities = true;     // 关闭后同一时刻的事件只按槽位排序
+    bool exceptions = true;     // 关闭后不再捕获回调抛出的异常，回调不能抛出
+    bool catchup = true;        // 关闭后 Repeat 事件总是 CatchUp::All
+    bool pause = true;          // 关闭后不支持 pause / resume 和事件组暂停
+    bool slack = true;          // 关闭后不支持 timer slack（set_slack / set_default_slack / next_wakeup）
+    bool deterministic = false; // 开启后同一时刻同一优先级的事件按调度顺序触发，与槽位复用无关
+    bool bucketing = false;     // 开启后同一 (next_fire, 优先级) 的事件共用一个堆节点，适合大量事件同时触发的场景
+    TimeMs tier_horizon = 0;    // 大于 0 时，比最早的事件晚 tier_horizon 以上的事件放在无序的 overflow 中，不参与堆操作
+    bool batch_run = false;     // 开启后 run() 先把所有事件一次性排序再按顺序触发，适合预先加载大量事件的离线模拟
+    bool snapshots = false;     // 开启后支持 save_state / restore_state，之后的修改记录为增量 undo log
+    bool keyed = false;         // 开启后支持按 uint64 key 调度（schedule_or_replace / cancel_by_key / find），内置哈希索引
+    bool jitter = false;        // 开启后 Repeat 事件每次重新调度时可以追加随机延迟，随机数来自调度器内可设种子的 PRNG
+    bool calendar = false;      // 开启后支持按 cron 日历表达式重复的事件（add_calendar / schedule_calendar）
+};
+
+// 调度器中已注册的日历表达式的下标
+using CalendarId = uint32_t;
+
+// 按 key 调度时表示没有 key，不能用作 key
+inline constexpr uint64_t no_key = ~uint64_t{0};
+
+// 被特性开关去掉的字段：不占空间，读出来总是默认值，写入会被忽略
+template <auto V> struct Fixed {
+    using value_type = decltype(V);
+    constexpr Fixed() noexcept = default;
+    constexpr Fixed(value_type) noexcept {}
+    constexpr operator value_type() const noexcept { return V; }
+    constexpr Fixed &operator+=(value_type) noexcept { return *this; }
+};
+
+template <bool Enabled, auto Default>
+using Field = std::conditional_t<Enabled, std::remove_const_t<decltype(Default)>, Fixed<Default>>;
+
 using DefaultCallback = std::function<void()>;
 
-template <typename Callback = DefaultCallback> struct EventDesc {
+// 函数指针 + 上下文 + 整数参数，没有类型擦除：24 字节，可平凡拷贝，触发时只有一次间接调用，不需要析构
+struct FnCallback {
+    using Fn = void (*)(void *ctx, uint64_t arg, EventID eid);
+
+    Fn fn = nullptr;
+    void *ctx = nullptr;
+    uint64_t arg = 0;
+
+    constexpr FnCallback() noexcept = default;
+    constexpr FnCallback(Fn f, void *c = nullptr, uint64_t a = 0) noexcept : fn(f), ctx(c), arg(a) {}
+
+    // 在 obj 上调用成员函数 M，M 的参数可以是 ()、(uint64_t) 或 (uint64_t, EventID)
+    template <auto M, typename T> static constexpr FnCallback bind(T *obj, uint64_t a = 0) noexcept {
+        return FnCallback(
+            [](void *c, uint64_t x, EventID eid) {
+                T *o = static_cast<T *>(c);
+                if constexpr (std::is_invocable_v<decltype(M), T *, uint64_t, EventID>) std::invoke(M, o, x, eid);
+                else if constexpr (std::is_invocable_v<decltype(M), T *, uint64_t>) std::invoke(M, o, x);
+                else std::invoke(M, o);
+            },
+            const_cast<void *>(static_cast<const void *>(std::addressof(*obj))), a);
+    }
+
+    void operator()(EventID eid) const { fn(ctx, arg, eid); }
+    explicit constexpr operator bool() const noexcept { return fn != nullptr; }
+};
+static_assert(std::is_trivially_copyable_v<FnCallback>);
+
+using HandlerId = uint32_t;
+inline constexpr HandlerId invalid_handler = UINT32_MAX;
+
+// 已注册的处理函数 + 定长 POD 负载。调度器用自己的处理函数表分发，事件本身可平凡拷贝，可以直接序列化。处理函数
+// 由 EventScheduler::register_handler 注册，HandlerId 只在同一个调度器（及其拷贝）中有意义
+template <size_t PayloadBytes = 16> struct HandlerCall {
+    static constexpr size_t payload_size = PayloadBytes;
+
+    template <typename P>
+    static constexpr bool is_payload_v = std::is_trivially_copyable_v<P> && sizeof(P) <= PayloadBytes;
+
+    HandlerId handler = invalid_handler;
+    alignas(8) std::byte payload[PayloadBytes]{};
+
+    template <typename P>
+        requires is_payload_v<P>
+    static HandlerCall make(HandlerId h, const P &p) noexcept {
+        HandlerCall c;
+        c.handler = h;
+        std::memcpy(c.payload, &p, sizeof(P));
+        return c;
+    }
+
+    template <typename P>
+        requires is_payload_v<P>
+    P load() const noexcept {
+        P p;
+        std::memcpy(&p, payload, sizeof(P));
+        return p;
+    }
+};
+
+template <typename T> struct is_handler_call : std::false_type {};
+template <size_t N> struct is_handler_call<HandlerCall<N>> : std::true_type {};
+template <typename T> inline constexpr bool is_handler_call_v = is_handler_call<T>::value;
+
+template <typename Callback = DefaultCallback, SchedulerTraits Traits = SchedulerTraits{}> struct EventDesc {
     EventType type = EventType::Once;
+    RepeatMode repeat = RepeatMode::FixedRate; // 仅限 Repeat 使用，占用 type 之后的填充，不增加大小
     TimeMs interval_ms = TimeMs{}; // 仅限 Repeat 使用
     Callback callback{};
-    ExceptionPolicy ep = ExceptionPolicy::Swallow;
-    EventPriority pri = EventPriority::User;
-    CatchUp cu = CatchUp::All;
+    ES_NO_UNIQUE_ADDRESS Field<Traits.exceptions, ExceptionPolicy::Swallow> ep = ExceptionPolicy::Swallow;
+    ES_NO_UNIQUE_ADDRESS Field<Traits.priorities, Priority{EventPriority::User}> pri = Priority{EventPriority::User};
+    ES_NO_UNIQUE_ADDRESS Field<Traits.catchup, CatchUp::All> cu = CatchUp::All;
+    ES_NO_UNIQUE_ADDRESS Field<Traits.keyed, no_key> key = no_key;
+    ES_NO_UNIQUE_ADDRESS Field<Traits.jitter, Jitter{}> jitter = Jitter{};
+    ES_NO_UNIQUE_ADDRESS Field<Traits.calendar, CalendarId{}> calendar = CalendarId{}; // 仅限 RepeatMode::Calendar 使用
+    // 允许推迟触发的时间窗口，窗口重叠的事件可以合并到同一次唤醒
+    ES_NO_UNIQUE_ADDRESS Field<Traits.slack, TimeMs{}> slack_ms = TimeMs{};
 };
 
 } // namespace es
\ No newline at end of file
@@ -15,4 +15,14 @@ struct EventID {
     bool operator!=(const EventID &rhs) const noexcept { return !(*this == rhs); }
 };
 
+struct GroupID {
+    static constexpr uint32_t u32max = std::numeric_limits<uint32_t>::max();
+    uint32_t index = u32max;
+    uint32_t gen = u32max;
+    static GroupID invalid() noexcept { return GroupID{u32max, u32max}; }
+    bool is_valid() const noexcept { return index != u32max && gen != u32max; }
+    bool operator==(const GroupID &rhs) const noexcept { return index == rhs.index && gen == rhs.gen; }
+    bool operator!=(const GroupID &rhs) const noexcept { return !(*this == rhs); }
+};
+
 } // namespace es
\ No newline at end of file
@@ -1,20 +1,36 @@
 // example.cpp
 #include "event.hpp"
 #include "event_id.hpp"
+#include "pdes.hpp"
 #include "scheduler.hpp"
 #include <Windows.h>
+#include <algorithm>
+#include <chrono>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory_resource>
 #include <random>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 using Scheduler = es::EventScheduler<>;
+using StaticScheduler = es::StaticEventScheduler<es::DefaultCallback, 256>;
+using BucketScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.bucketing = true}>;
+using TieredScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.tier_horizon = 50}>;
+using SnapshotScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.snapshots = true}>;
+using CowScheduler = es::CowEventScheduler<es::DefaultCallback, es::SchedulerTraits{}, 16>;
+using KeyedScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.keyed = true}>;
+using JitterScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.jitter = true}>;
+using CalendarScheduler = es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.calendar = true}>;
 using EventID = es::EventID;
 using TimeMs = es::TimeMs;
 using TimeMode = es::TimeMode;
@@ -88,8 +104,8 @@ static void expect_seq(const std::vector<std::string> &got, const std::vector<st
 // -----------------------------
 
 // 1) 基础：relative once + repeat，同时刻 tie-break（index）
-static void test_basic_order_and_tie_break() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_basic_order_and_tie_break() {
+    S s;
     Trace t;
 
     // index 0
@@ -116,8 +132,8 @@ static void test_basic_order_and_tie_break() {
 }
 
 // 2) Absolute vs Relative
-static void test_absolute_time() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_absolute_time() {
+    S s;
     Trace t;
 
     s.schedule(100, [&] { t.push("rel+100"); }, TimeMode::Relative, EventType::Once);
@@ -141,8 +157,8 @@ static void test_absolute_time() {
 }
 
 // 3) Priority：同一 next_fire，pri 小的先（System(0) > User(1) > Debug(2) 的相反顺序）
-static void test_priority_order() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_priority_order() {
+    S s;
     Trace t;
 
     s.schedule(
@@ -163,8 +179,8 @@ static void test_priority_order() {
 }
 
 // 4) tick(0) 语义：tick 内 schedule(0) 不会在同一次 tick 中触发
-static void test_tick0_semantics_and_schedule_during_tick() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_tick0_semantics_and_schedule_during_tick() {
+    S s;
     Trace t;
 
     s.schedule(100, [&] {
@@ -180,8 +196,8 @@ static void test_tick0_semantics_and_schedule_during_tick() {
 }
 
 // 5) callback 内 cancel 自己 (Repeat)：应该只触发一次
-static void test_cancel_self_in_callback_repeat() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_cancel_self_in_callback_repeat() {
+    S s;
     size_t cnt = 0;
     EventID id = EventID::invalid();
 
@@ -199,10 +215,10 @@ static void test_cancel_self_in_callback_repeat() {
 }
 
 // 6) ExceptionPolicy：Swallow + CancelEvent（Rethrow 见下方演示）
-static void test_exception_policy_swallow_and_cancel_event() {
+template <typename S = Scheduler> static void test_exception_policy_swallow_and_cancel_event() {
     // Swallow: repeat 仍会继续 reschedule
     {
-        Scheduler s;
+        S s;
         size_t fired = 0;
         s.schedule(
             10,
@@ -220,7 +236,7 @@ static void test_exception_policy_swallow_and_cancel_event() {
 
     // CancelEvent: repeat 第一次抛异常就会 cancel，然后不再继续
     {
-        Scheduler s;
+        S s;
         size_t fired = 0;
         s.schedule(
             10,
@@ -237,8 +253,8 @@ static void test_exception_policy_swallow_and_cancel_event() {
 }
 
 // 7) pause/resume：暂停期间 tick 只累计时间，不触发；resume 一次性补上
-static void test_pause_resume() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_pause_resume() {
+    S s;
     size_t cnt = 0;
 
     s.schedule(100, [&] { ++cnt; }, TimeMode::Relative, EventType::Repeat, 100);
@@ -257,21 +273,25 @@ static void test_pause_resume() {
     EXPECT_EQ(cnt, size_t(7));
 }
 
-// 8) cancelled > alive 触发 rebuild_pq，验证 free-list 复用 + gen 防旧ID
-static void test_rebuild_and_generation_safety() {
-    Scheduler s;
+// 8) 关闭增量清理（budget = 0）时 cancelled > alive 在 cancel 中同步 rebuild_pq，验证 free-list 复用 + gen 防旧ID
+template <typename S = Scheduler> static void test_rebuild_and_generation_safety() {
+    S s;
+    s.set_gc_policy(es::GcPolicy{.budget = 0});
 
-    // schedule 10 once events far in future
+    // schedule 10 once events far in future; ids[9] is the earliest, so the cancelled ones never reach the top
     std::vector<EventID> ids;
     ids.reserve(10);
     for (int i = 0; i < 10; ++i) {
-        ids.push_back(s.schedule(10'000 + i, [] {}));
+        ids.push_back(s.schedule(10'000 - i, [] {}));
     }
     EXPECT_EQ(s.size(), size_t(10));
 
     // cancel 9 of them, leaving 1 alive => cancelled(9) > alive(1) triggers rebuild_pq inside cancel
     for (size_t i = 0; i < 9; ++i) s.cancel(ids[i]);
     EXPECT_EQ(s.size(), size_t(1));
+    EXPECT_EQ(s._pq_size(), size_t(1));
+    EXPECT_EQ(s.gc_stats().collected, size_t(9));
+    EXPECT_EQ(s.gc_stats().sweeps, size_t(0));
 
     // Now schedule 9 new events, they should reuse the cancelled slots (indices among those 9)
     std::set<uint32_t> cancelled_indices;
@@ -296,7 +316,7 @@ static void test_rebuild_and_generation_safety() {
     s.tick(100);
     EXPECT_EQ(s.size(), size_t(1)); // the original alive future event still there
 
-    // And the original alive one still triggers at 10000+
+    // And the original alive one still triggers at 9991
     size_t marker = 0;
     EventID far_id = ids[9];
     s.cancel(far_id); // make it quiet and end
@@ -305,8 +325,8 @@ static void test_rebuild_and_generation_safety() {
 }
 
 // 9) clear 重置行为 + schedule(0) 不立即触发
-static void test_clear_resets() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_clear_resets() {
+    S s;
     size_t cnt = 0;
 
     s.schedule(1000, [&] { ++cnt; });
@@ -326,8 +346,8 @@ static void test_clear_resets() {
 }
 
 // 10) 轻 fuzz：只用 Once，随机 schedule/cancel/tick，最后推进到 horizon 结束应全部清空
-static void test_fuzz_once_only() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_fuzz_once_only() {
+    S s;
     std::mt19937 rng(123456);
     std::uniform_int_distribution<int> op_dist(0, 2); // 0 schedule, 1 cancel, 2 tick
     std::uniform_int_distribution<int> delay_dist(0, 200);
@@ -379,8 +399,8 @@ static void test_fuzz_once_only() {
 // Known sharp edges / demos (disabled)
 // -----------------------------
 
-static void test_rethrow() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_rethrow() {
+    S s;
     s.schedule(
         10, [] { throw std::runtime_error("rethrow"); }, TimeMode::Relative, EventType::Once, 0,
         ExceptionPolicy::Rethrow, EventPriority::User);
@@ -398,8 +418,8 @@ static void test_rethrow() {
     }
 }
 
-static void test_clear_then_schedule_in_same_tick() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_clear_then_schedule_in_same_tick() {
+    S s;
     Trace t;
 
     EventID id_before = EventID::invalid();
@@ -445,8 +465,8 @@ static void test_clear_then_schedule_in_same_tick() {
     EXPECT_EQ(s.size(), size_t(0));
 }
 
-static void test_double_clear_then_schedule_in_same_tick() {
-    Scheduler s;
+template <typename S = Scheduler> static void test_double_clear_then_schedule_in_same_tick() {
+    S s;
     Trace t;
 
     EventID id_after = EventID::invalid();
@@ -485,24 +505,1721 @@ static void demo_assert_bug_repeat_latest_not_due() {
     EXPECT(t.log.empty());
 }
 
+// 15) 事件组：cancel / pause / resume / delay 只影响组内事件
+template <typename S = Scheduler> static void test_event_groups() {
+    S s;
+    Trace t;
+
+    es::GroupID g = s.create_group();
+    s.schedule_in(g, 100, [&] { t.push("g1"); });
+    s.schedule_in(g, 200, [&] { t.push("g2"); }, TimeMode::Relative, EventType::Repeat, 200);
+    s.schedule(150, [&] { t.push("other"); });
+    EXPECT_EQ(s.group_size(g), size_t(2));
+
+    // 暂停后组内事件不触发，剩余时间保持不变
+    s.pause_group(g);
+    s.tick(500);
+    expect_seq(t.log, {"other"});
+    EXPECT_EQ(s.size(), size_t(2));
+
+    // 恢复后 g1 还剩 100ms，g2 还剩 200ms
+    s.resume_group(g);
+    s.tick(100);
+    expect_seq(t.log, {"other", "g1"});
+    EXPECT_EQ(s.group_size(g), size_t(1));
+
+    // 推迟整组
+    s.delay_group(g, 50);
+    s.tick(100);
+    expect_seq(t.log, {"other", "g1"});
+    s.tick(50);
+    expect_seq(t.log, {"other", "g1", "g2"});
+
+    // 取消整组，组外事件不受影响
+    s.schedule(1000, [&] { t.push("keep"); });
+    s.schedule_in(g, 10, [&] { t.push("g3"); });
+    EXPECT_EQ(s.cancel_group(g), size_t(2));
+    EXPECT_EQ(s.group_size(g), size_t(0));
+    s.tick(1000);
+    expect_seq(t.log, {"other", "g1", "g2", "keep"});
+    EXPECT_EQ(s.size(), size_t(0));
+
+    // 加入已暂停的组的事件直接暂停；销毁组后旧 GroupID 失效
+    s.pause_group(g);
+    EventID id = s.schedule_in(g, 10, [&] { t.push("paused"); });
+    s.tick(100);
+    EXPECT(s.is_alive(id));
+    s.destroy_group(g);
+    EXPECT(!s.is_alive(id));
+    EXPECT_EQ(s.group_size(g), size_t(0));
+    EXPECT(s.create_group() != g);
+    s.tick(100);
+    expect_seq(t.log, {"other", "g1", "g2", "keep"});
+    EXPECT_EQ(s.size(), size_t(0));
+}
+
+// 16) timer slack：窗口重叠的事件合并到同一次唤醒
+template <typename S = Scheduler> static void test_timer_slack_coalescing() {
+    S s;
+    size_t cnt = 0;
+
+    // 100, 103, 106, 109：slack = 10 时可以在 110 一次唤醒全部触发
+    s.set_default_slack(10);
+    for (TimeMs t = 100; t < 110; t += 3) s.schedule(t, [&] { ++cnt; });
+    // 200 不在窗口内
+    EventID far = s.schedule(200, [&] { ++cnt; });
+    s.set_slack(far, 0);
+
+    auto wake = s.next_wakeup();
+    REQUIRE(wake.has_value());
+    EXPECT_EQ(*wake, TimeMs(110)); // min(100 + 10, 103 + 10, ...)
+    s.tick_until(*wake);
+    EXPECT_EQ(cnt, size_t(4));
+
+    wake = s.next_wakeup();
+    REQUIRE(wake.has_value());
+    EXPECT_EQ(*wake, TimeMs(200));
+    s.tick_until(*wake);
+    EXPECT_EQ(cnt, size_t(5));
+    EXPECT(!s.next_wakeup().has_value());
+
+    // 2 次唤醒，5 个不同的触发时刻
+    EXPECT_EQ(s.wakeup_stats().wakeups, size_t(2));
+    EXPECT_EQ(s.wakeup_stats().deadlines, size_t(5));
+    EXPECT_EQ(s.wakeup_stats().saved(), size_t(3));
+
+    // 取消的事件不参与合并
+    s.reset_wakeup_stats();
+    EventID early = s.schedule(10, [&] { ++cnt; });
+    s.schedule(50, [&] { ++cnt; });
+    s.set_slack(early, 0);
+    EXPECT_EQ(*s.next_wakeup(), s.now() + 10);
+    s.cancel(early);
+    EXPECT_EQ(*s.next_wakeup(), s.now() + 60);
+}
+
+// 17) 整数优先级：同一 next_fire 按优先级数值排序，EventPriority 是其中的别名
+static void test_numeric_priority() {
+    {
+        Scheduler s;
+        Trace t;
+        auto at = [&](int pri, std::string name) {
+            s.schedule_after(
+                100, [&t, name] { t.push(name); }, EventType::Once, 0, ExceptionPolicy::Swallow, es::Priority(pri));
+        };
+        at(200, "net");
+        at(0, "sys");
+        at(129, "ai");
+        at(127, "physics");
+        s.schedule_after(
+            100, [&] { t.push("user"); }, EventType::Once, 0, ExceptionPolicy::Swallow, EventPriority::User);
+        EventID dbg = s.schedule_after(
+            100, [&] { t.push("debug->first"); }, EventType::Once, 0, ExceptionPolicy::Swallow, EventPriority::Debug);
+        s.set_priority(dbg, 1); // 重新入堆
+        s.tick(100);
+        expect_seq(t.log, {"sys", "debug->first", "physics", "user", "ai", "net"});
+    }
+
+    // 自定义位宽
+    {
+        es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.priority_bits = 4}> s;
+        Trace t;
+        for (int pri = 15; pri >= 0; pri -= 5) {
+            s.schedule_after(
+                10, [&t, pri] { t.push(std::to_string(pri)); }, EventType::Once, 0, ExceptionPolicy::Swallow, pri);
+        }
+        s.tick(10);
+        expect_seq(t.log, {"0", "5", "10", "15"});
+    }
+
+    // 位宽小于 8 时默认参数和 EventPriority 的别名缩放到可用范围：User 是中点，排在 7 之后、9 之前
+    auto narrow = [](auto &s) {
+        Trace t;
+        s.schedule(10, [&] { t.push("user"); });
+        s.schedule_after(
+            10, [&] { t.push("debug"); }, EventType::Once, 0, ExceptionPolicy::Swallow, EventPriority::Debug);
+        s.schedule_after(
+            10, [&] { t.push("system"); }, EventType::Once, 0, ExceptionPolicy::Swallow, EventPriority::System);
+        EventID late = s.schedule(10, [&] { t.push("9"); });
+        s.set_priority(late, 9);
+        s.schedule_after(10, [&] { t.push("7"); }, EventType::Once, 0, ExceptionPolicy::Swallow, 7);
+        s.schedule_after(10, [&] { t.push("15"); }, EventType::Once, 0, ExceptionPolicy::Swallow, 15);
+        s.tick(10);
+        expect_seq(t.log, {"system", "7", "user", "9", "debug", "15"});
+    };
+    {
+        es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.priority_bits = 4}> s;
+        narrow(s);
+    }
+    {
+        es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.priority_bits = 4, .deterministic = true}> s;
+        narrow(s);
+    }
+
+    // delay 之后 EventID 仍然有效
+    {
+        Scheduler s;
+        size_t cnt = 0;
+        EventID id = s.schedule(100, [&] { ++cnt; });
+        s.delay(id, 50);
+        EXPECT(s.is_alive(id));
+        s.delay(id, -50);
+        s.tick(100);
+        EXPECT_EQ(cnt, size_t(1));
+        EXPECT_EQ(s.size(), size_t(0));
+        EXPECT(!s.is_alive(id));
+    }
+}
+
+// 18) next_deadline 总是最近一个会触发的事件；due_count 跳过 cancel 和旧节点
+template <typename S = Scheduler> static void test_next_deadline_and_due_count() {
+    S s;
+    EXPECT(!s.next_deadline().has_value());
+
+    EventID a = s.schedule(100, [] {});
+    EventID b = s.schedule(200, [] {});
+    s.schedule(300, [] {});
+    s.schedule(300, [] {});
+    EXPECT_EQ(*s.next_deadline(), TimeMs(100));
+
+    s.cancel(a);
+    EXPECT_EQ(*s.next_deadline(), TimeMs(200));
+    EXPECT(s.peek()->first == b);
+
+    s.delay(b, 150); // 200 -> 350
+    EXPECT_EQ(*s.next_deadline(), TimeMs(300));
+    EXPECT_EQ(s.due_count(299), size_t(0));
+    EXPECT_EQ(s.due_count(300), size_t(2));
+    EXPECT_EQ(s.due_count(350), size_t(3));
+
+    s.tick(300);
+    EXPECT_EQ(*s.next_deadline(), TimeMs(350));
+    s.tick(50);
+    EXPECT(!s.next_deadline().has_value());
+
+    // 随机操作后与暴力计算的结果比较
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> op_dist(0, 3);
+    std::uniform_int_distribution<int> time_dist(1, 500);
+    std::vector<EventID> ids;
+    for (int step = 0; step < 2000; ++step) {
+        int op = op_dist(rng);
+        if (op == 0) ids.push_back(s.schedule(time_dist(rng), [] {}));
+        else if (op == 1 && !ids.empty()) s.cancel(ids[static_cast<size_t>(time_dist(rng)) % ids.size()]);
+        else if (op == 2 && !ids.empty()) {
+            EventID id = ids[static_cast<size_t>(time_dist(rng)) % ids.size()];
+            if (s.is_alive(id)) s.delay(id, time_dist(rng) - 250);
+        } else s.tick(time_dist(rng) / 10);
+
+        std::optional<TimeMs> want;
+        size_t due = 0;
+        for (EventID id : ids) {
+            if (!s.is_alive(id)) continue;
+            TimeMs t = s._event_of(id).next_fire;
+            if (!want || t < *want) want = t;
+            if (t <= s.now() + 100) ++due;
+        }
+        EXPECT(s.next_deadline() == want);
+        EXPECT_EQ(s.due_count(s.now() + 100), due);
+    }
+}
+
+// 19) compact：搬动活跃事件、释放槽位，旧 EventID 永远失效
+static void test_compact() {
+    Scheduler s;
+    size_t cnt = 0;
+    std::vector<EventID> ids;
+    for (int i = 0; i < 1000; ++i) ids.push_back(s.schedule(100 + i, [&] { ++cnt; }));
+    std::vector<EventID> keep;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % 100 == 99) keep.push_back(ids[i]);
+        else s.cancel(ids[i]);
+    }
+    EXPECT_EQ(s.size(), size_t(10));
+
+    es::GroupID g = s.create_group();
+    EventID paused = s.schedule_in(g, 10, [&] { ++cnt; });
+    s.pause_group(g);
+
+    std::vector<std::pair<EventID, EventID>> moves;
+    size_t released = s.compact([&](EventID o, EventID n) { moves.emplace_back(o, n); });
+    EXPECT_EQ(s._capacity(), size_t(11));
+    EXPECT_EQ(released, size_t(989)); // 暂停的事件复用了一个被回收的槽位
+    EXPECT_EQ(moves.size(), size_t(11));
+    EXPECT_EQ(s._fl_size(), size_t(0));
+    EXPECT_EQ(s._pq_size(), size_t(10));
+
+    // 旧 EventID 全部失效，新 EventID 有效
+    for (EventID id : ids) EXPECT(!s.is_alive(id));
+    EXPECT(!s.is_alive(paused));
+    EventID new_paused = EventID::invalid();
+    for (auto &[o, n] : moves) {
+        EXPECT(s.is_alive(n));
+        if (o == paused) new_paused = n;
+    }
+    EXPECT(s.is_alive(new_paused));
+    EXPECT_EQ(s.group_size(g), size_t(1));
+
+    // 旧 EventID 不会因为槽位重新分配而生效
+    for (int i = 0; i < 2000; ++i) s.schedule(5000, [] {});
+    for (EventID id : ids) EXPECT(!s.cancel(id));
+    EXPECT_EQ(s.size(), size_t(2011));
+
+    s.tick(1200);
+    EXPECT_EQ(cnt, size_t(10));
+    s.resume_group(g);
+    s.tick(10);
+    EXPECT_EQ(cnt, size_t(11));
+
+    // 自动压缩：tick 结束后检查，压缩之后需要再次出现峰值才会触发
+    Scheduler a;
+    size_t auto_moves = 0;
+    a.set_compact_policy(es::CompactPolicy{.min_slots = 64, .slots_per_alive = 4},
+                         [&](EventID, EventID) { ++auto_moves; });
+    for (int i = 0; i < 200; ++i) a.schedule(i < 190 ? 10 : 1000, [] {});
+    a.tick(10);
+    EXPECT_EQ(a._capacity(), size_t(10));
+    EXPECT_EQ(auto_moves, size_t(10));
+    for (int i = 0; i < 30; ++i) a.schedule(10, [] {});
+    a.tick(10);
+    EXPECT_EQ(a._capacity(), size_t(40));
+}
+
+// 20) pmr：内部容器和支持 uses-allocator 的回调都从调度器的内存资源分配
+struct CountingResource : std::pmr::memory_resource {
+    std::pmr::memory_resource *upstream;
+    size_t allocs = 0;
+    explicit CountingResource(std::pmr::memory_resource *up) : upstream(up) {}
+    void *do_allocate(size_t bytes, size_t align) override {
+        ++allocs;
+        return upstream->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override { upstream->deallocate(p, bytes, align); }
+    bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override { return this == &o; }
+};
+
+struct NamedCallback {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+    std::pmr::string name;
+    size_t *counter = nullptr;
+    explicit NamedCallback(const allocator_type &a = {}) : name(a) {}
+    NamedCallback(const char *n, size_t *c, const allocator_type &a) : name(n, a), counter(c) {}
+    NamedCallback(const NamedCallback &o, const allocator_type &a) : name(o.name, a), counter(o.counter) {}
+    NamedCallback(NamedCallback &&o, const allocator_type &a) : name(std::move(o.name), a), counter(o.counter) {}
+    NamedCallback(const NamedCallback &) = default;
+    NamedCallback(NamedCallback &&) = default;
+    NamedCallback &operator=(const NamedCallback &) = default;
+    NamedCallback &operator=(NamedCallback &&) = default;
+    void operator()() { ++*counter; }
+};
+
+static void test_pmr_allocator() {
+    std::vector<std::byte> buf(1 << 20);
+    CountingResource def(std::pmr::new_delete_resource());
+    std::pmr::memory_resource *old = std::pmr::set_default_resource(&def);
+    {
+        std::pmr::monotonic_buffer_resource arena(buf.data(), buf.size(), std::pmr::null_memory_resource());
+        CountingResource counted(&arena);
+        size_t cnt = 0;
+        {
+            es::pmr::EventScheduler<NamedCallback> s(&counted);
+            std::vector<EventID> ids;
+            for (int i = 0; i < 200; ++i) {
+                NamedCallback cb("a name long enough to skip SSO", &cnt, s.get_allocator());
+                ids.push_back(s.schedule(i % 50, std::move(cb)));
+            }
+            for (size_t i = 0; i < ids.size(); i += 2) s.cancel(ids[i]);
+            s.compact();
+            s.tick(25);
+            s.schedule(0, NamedCallback("scheduled after compact, also long", &cnt, s.get_allocator()));
+            s.tick(100);
+            EXPECT_EQ(s.size(), size_t(0));
+        }
+        EXPECT_EQ(cnt, size_t(101));
+        EXPECT(counted.allocs > 0);
+    }
+    std::pmr::set_default_resource(old);
+    EXPECT_EQ(def.allocs, size_t(0));
+}
+
+// 21) 编译期特性开关：关闭的特性不占空间，相关接口不可用，其余语义不变
+constexpr es::SchedulerTraits kMinimalTraits{.priorities = false, .exceptions = false, .catchup = false, .pause = false,
+                                          .slack = false};
+using MinimalScheduler = es::EventScheduler<es::DefaultCallback, kMinimalTraits>;
+
+template <typename S> concept Pausable = requires(S &s) { s.pause(); };
+template <typename S> concept Prioritized = requires(S &s) { s.set_priority(EventID{}, 0); };
+template <typename S> concept Slacked = requires(S &s) { s.next_wakeup(); };
+
+static void test_minimal_traits() {
+    static_assert(sizeof(es::EventDesc<es::DefaultCallback, kMinimalTraits>) < sizeof(es::EventDesc<>));
+    static_assert(Pausable<Scheduler> && !Pausable<MinimalScheduler>);
+    static_assert(Prioritized<Scheduler> && !Prioritized<MinimalScheduler>);
+    static_assert(Slacked<Scheduler> && !Slacked<MinimalScheduler>);
+
+    MinimalScheduler s;
+    Trace t;
+    // 优先级被忽略，同一时刻按槽位排序
+    s.schedule(
+        100, [&] { t.push("debug"); }, TimeMode::Relative, EventType::Once, 0, ExceptionPolicy::Swallow,
+        EventPriority::Debug);
+    s.schedule(
+        100, [&] { t.push("system"); }, TimeMode::Relative, EventType::Once, 0, ExceptionPolicy::Swallow,
+        EventPriority::System);
+    // CatchUp::Latest 被忽略，总是触发全部
+    size_t cnt = 0;
+    s.schedule_after(
+        10, [&] { ++cnt; }, EventType::Repeat, 10, ExceptionPolicy::Swallow, EventPriority::User, CatchUp::Latest);
+    s.tick(100);
+    expect_seq(t.log, {"debug", "system"});
+    EXPECT_EQ(cnt, size_t(10));
+    EXPECT_EQ(s.size(), size_t(1));
+
+    // 关闭异常处理后异常直接穿出 tick
+    s.clear();
+    s.schedule(0, [] { throw std::runtime_error("boom"); });
+    bool thrown = false;
+    try {
+        s.tick(0);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    EXPECT(thrown);
+}
+
+// 22) 固定容量：容量用完时 schedule / create_group 失败，旧节点过多时原地清理
+static size_t g_fn_calls = 0;
+static void count_call() { ++g_fn_calls; }
+
+static void test_static_capacity() {
+    using Tiny = es::StaticEventScheduler<void (*)(), 4>;
+    Tiny s;
+    g_fn_calls = 0;
+    std::vector<EventID> ids;
+    for (int i = 0; i < 4; ++i) ids.push_back(s.schedule(10 + i, count_call));
+    EXPECT(!s.schedule(100, count_call).is_valid());
+    EXPECT_EQ(s.size(), size_t(4));
+
+    // cancel 之后槽位可以复用
+    s.cancel(ids[0]);
+    EXPECT(s.schedule(5, count_call).is_valid());
+    EXPECT(!s.is_alive(ids[0]));
+
+    // 反复修改触发时间产生大量旧节点，堆满时原地清理
+    for (int round = 0; round < 100; ++round)
+        for (EventID id : ids)
+            if (s.is_alive(id)) s.delay(id, 1);
+    EXPECT(s._pq_size() <= 8);
+    EXPECT_EQ(*s.next_deadline(), TimeMs(5));
+    s.tick(200);
+    EXPECT_EQ(g_fn_calls, size_t(4));
+    EXPECT_EQ(s.size(), size_t(0));
+
+    // tick 中调度同样受容量限制：触发中的槽位要到 tick 结束才回收
+    static Tiny *cur = nullptr;
+    static size_t ok = 0;
+    cur = &s;
+    ok = 0;
+    s.schedule(0, [] {
+        for (int i = 0; i < 8; ++i) ok += cur->schedule(10, count_call).is_valid();
+    });
+    s.tick(0);
+    EXPECT_EQ(ok, size_t(3));
+    EXPECT_EQ(s.size(), size_t(3));
+    s.clear();
+    EXPECT(s.schedule(0, count_call).is_valid());
+
+    // 组也有上限
+    std::vector<es::GroupID> groups;
+    for (int i = 0; i < 4; ++i) groups.push_back(s.create_group());
+    EXPECT(!s.create_group().is_valid());
+    s.destroy_group(groups[0]);
+    EXPECT(s.create_group().is_valid());
+}
+
+// 23) FnCallback：函数指针 + ctx + arg，可平凡拷贝，可以绑定成员函数
+struct Counter {
+    uint64_t sum = 0;
+    std::vector<EventID> fired;
+    void add(uint64_t a) { sum += a; }
+    void add_and_log(uint64_t a, EventID eid) {
+        sum += a;
+        fired.push_back(eid);
+    }
+};
+
+static void test_fn_callback() {
+    static_assert(sizeof(es::FnCallback) == 24);
+    static_assert(std::is_trivially_copyable_v<es::EventDesc<es::FnCallback>>);
+
+    es::EventScheduler<es::FnCallback> s;
+    Counter c;
+    s.schedule(10, es::FnCallback::bind<&Counter::add>(&c, 3));
+    EventID id = s.schedule(20, es::FnCallback::bind<&Counter::add_and_log>(&c, 4));
+    s.schedule_after(
+        5, es::FnCallback::bind<&Counter::add>(&c, 1), EventType::Repeat, 5, ExceptionPolicy::Swallow,
+        EventPriority::User, CatchUp::All);
+    // 也可以直接传入原始函数指针，ctx 和 arg 为空
+    static bool raw_called = false;
+    s.schedule(15, +[](void *ctx, uint64_t a, EventID) { raw_called = ctx == nullptr && a == 0; });
+    s.schedule(15, es::FnCallback(+[](void *ctx, uint64_t a, EventID) { static_cast<Counter *>(ctx)->sum += a; },
+                                  &c, 1000));
+    s.tick(20);
+    EXPECT_EQ(c.sum, uint64_t(3 + 4 + 4 * 1 + 1000));
+    EXPECT(c.fired.size() == 1 && c.fired[0] == id);
+    EXPECT(raw_called);
+
+    // 固定容量 + FnCallback 完全不分配内存
+    es::StaticEventScheduler<es::FnCallback, 16> fs;
+    fs.schedule(1, es::FnCallback::bind<&Counter::add>(&c, 7));
+    fs.tick(1);
+    EXPECT_EQ(c.sum, uint64_t(1018));
+}
+
+// 24) HandlerCall：注册处理函数后按 (HandlerId, POD 负载) 调度，事件可平凡拷贝，拷贝调度器即可重放
+struct Damage {
+    uint32_t target;
+    int32_t amount;
+};
+struct Spawn {
+    uint16_t kind;
+    uint16_t count;
+};
+static std::vector<std::string> g_handler_log;
+static void on_damage(const Damage &d, EventID) {
+    g_handler_log.push_back("dmg" + std::to_string(d.target) + ":" + std::to_string(d.amount));
+}
+static void on_spawn(const Spawn &sp) { g_handler_log.push_back("spawn" + std::to_string(sp.kind * 10 + sp.count)); }
+
+static void test_handler_registry() {
+    using Call = es::HandlerCall<8>;
+    static_assert(std::is_trivially_copyable_v<es::EventDesc<Call>>);
+    static_assert(Call::is_payload_v<Damage> && !Call::is_payload_v<std::string>);
+
+    es::EventScheduler<Call> s;
+    es::HandlerId dmg = s.register_handler<&on_damage>();
+    es::HandlerId spawn = s.register_handler<&on_spawn>();
+    EXPECT(dmg != spawn);
+    EXPECT_EQ(s.num_handlers(), size_t(2));
+
+    s.schedule(10, Call::make(dmg, Damage{7, -3}));
+    s.schedule_after(
+        5, Call::make(spawn, Spawn{2, 1}), EventType::Repeat, 10, ExceptionPolicy::Swallow, EventPriority::User,
+        CatchUp::All);
+
+    // 拷贝之后两边以同样的顺序触发同样的事件
+    es::EventScheduler<Call> replay = s;
+    g_handler_log.clear();
+    s.tick(15);
+    std::vector<std::string> first = g_handler_log;
+    expect_seq(first, {"spawn21", "dmg7:-3", "spawn21"});
+    g_handler_log.clear();
+    replay.tick(15);
+    expect_seq(g_handler_log, first);
+
+    // 固定容量的调度器同样可用，完全不分配内存
+    es::StaticEventScheduler<Call, 8> fs;
+    es::HandlerId h = fs.register_handler<&on_damage>();
+    g_handler_log.clear();
+    fs.schedule(1, Call::make(h, Damage{1, 2}));
+    fs.tick(1);
+    expect_seq(g_handler_log, {"dmg1:2"});
+}
+
+// 25) 分桶：同一 (next_fire, 优先级) 的事件共用一个堆节点，顺序与不分桶时相同
+static void test_bucketing() {
+    BucketScheduler s;
+    Scheduler ref;
+    std::vector<std::string> got, want;
+    std::mt19937 rng(99);
+    std::uniform_int_distribution<int> time_dist(0, 3);
+    std::uniform_int_distribution<int> pri_dist(0, 2);
+    std::vector<EventID> ids, ref_ids;
+    for (int i = 0; i < 300; ++i) {
+        TimeMs t = 10 * time_dist(rng);
+        uint32_t pri = static_cast<uint32_t>(pri_dist(rng));
+        ids.push_back(s.schedule(
+            t, [&got, i] { got.push_back(std::to_string(i)); }, TimeMode::Relative, EventType::Once, 0,
+            ExceptionPolicy::Swallow, pri));
+        ref_ids.push_back(ref.schedule(
+            t, [&want, i] { want.push_back(std::to_string(i)); }, TimeMode::Relative, EventType::Once, 0,
+            ExceptionPolicy::Swallow, pri));
+        // 穿插 cancel，让槽位乱序复用
+        if (i % 7 == 3) {
+            s.cancel(ids[static_cast<size_t>(i / 2)]);
+            ref.cancel(ref_ids[static_cast<size_t>(i / 2)]);
+        }
+    }
+    // 4 个时刻 x 3 个优先级
+    EXPECT(s._pq_heap_size() <= 12);
+    EXPECT_EQ(s._pq_size(), ref._pq_size());
+    s.tick(30);
+    ref.tick(30);
+    expect_seq(got, want);
+    EXPECT_EQ(s._pq_heap_size(), size_t(0));
+}
+
+// 26) deterministic：同一时刻同一优先级按调度顺序触发，槽位复用历史不同的调度器重放结果相同
+template <typename S> static std::vector<std::string> replay_script(S &s, uint32_t seed) {
+    std::vector<std::string> log;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> time_dist(0, 4);
+    std::uniform_int_distribution<int> pri_dist(0, 1);
+    std::vector<EventID> ids;
+    for (int i = 0; i < 200; ++i) {
+        TimeMs t = 5 * time_dist(rng);
+        uint32_t pri = static_cast<uint32_t>(pri_dist(rng));
+        std::string tag = std::to_string(i);
+        EventType type = i % 10 == 0 ? EventType::Repeat : EventType::Once;
+        ids.push_back(s.schedule(
+            t,
+            [&s, &log, tag] {
+                log.push_back(tag);
+                // 回调中调度的事件同样按调用顺序排序
+                if (log.size() % 17 == 0) s.schedule(0, [&log, tag] { log.push_back(tag + "'"); });
+            },
+            TimeMode::Relative, type, 5, ExceptionPolicy::Swallow, pri));
+        if (i % 6 == 5) s.cancel(ids[static_cast<size_t>(i - 3)]);
+    }
+    for (int i = 0; i < 6; ++i) s.tick(5);
+    return log;
+}
+
+template <es::SchedulerTraits Traits> static void test_deterministic_replay() {
+    using S = es::EventScheduler<es::DefaultCallback, Traits>;
+    // b 先用乱序 cancel 打乱 free list
+    S a, b;
+    std::vector<EventID> warm;
+    for (int i = 0; i < 100; ++i) warm.push_back(b.schedule(1000, [] {}));
+    std::mt19937 rng(5);
+    std::shuffle(warm.begin(), warm.end(), rng);
+    for (EventID id : warm) b.cancel(id);
+    b.tick(0);
+    b.tick_until(0);
+    EXPECT(a.now() == b.now());
+
+    std::vector<std::string> la = replay_script(a, 77);
+    std::vector<std::string> lb = replay_script(b, 77);
+    EXPECT(la.size() > 200);
+    expect_seq(lb, la);
+
+    // 同一时刻同一优先级时，先调度的先触发，即使它占用的槽位 index 更大
+    S c;
+    std::vector<std::string> log;
+    EventID x = c.schedule(1, [] {});
+    c.schedule(1, [] {});
+    c.cancel(x);
+    c.tick(1); // 槽位 0 回收，槽位 1 回收
+    c.schedule(10, [&] { log.push_back("first"); });
+    c.schedule(10, [&] { log.push_back("second"); });
+    c.schedule(10, [&] { log.push_back("third"); });
+    c.tick(10);
+    expect_seq(log, {"first", "second", "third"});
+}
+
+// 27) 增量垃圾回收：准确统计旧节点和 cancel 节点，cancel 中不再同步重建，之后每次 tick 最多检查 budget 个节点
+template <typename S> static void expect_gc_consistent(const S &s) {
+    size_t queued = 0, queued_cancelled = 0;
+    for (const auto &e : s._events()) {
+        if (!e.queued) continue;
+        ++queued;
+        if (e.status == es::EventStatus::Cancelled) ++queued_cancelled;
+    }
+    es::GcStats st = s.gc_stats();
+    EXPECT_EQ(st.nodes, queued + st.stale);
+    EXPECT_EQ(st.cancelled, queued_cancelled);
+}
+
+template <typename S = Scheduler> static void test_incremental_gc() {
+    S s;
+    s.set_gc_policy(es::GcPolicy{.max_garbage_ratio = 0.25, .min_garbage = 16, .budget = 64});
+    std::vector<EventID> ids;
+    for (int i = 0; i < 1000; ++i) ids.push_back(s.schedule(1000 + i % 100, [] {}));
+    // 延后靠后的事件，堆顶不受影响，旧节点不会被顺带清理；delay 本身不推进清理
+    for (size_t i = 0; i < 1000; ++i)
+        if (i % 100 >= 10) s.delay(ids[i], 1000);
+    expect_gc_consistent(s);
+    EXPECT_EQ(s._pq_size(), size_t(1900));
+    EXPECT_EQ(s.gc_stats().stale, size_t(900));
+    EXPECT_EQ(s.gc_stats().sweeps, size_t(0));
+
+    // 每次 tick 最多回收 budget 个节点；分桶时以桶为单位检查，最多多出一个桶（10 个节点）
+    size_t before = s._pq_size();
+    s.tick(1);
+    EXPECT_EQ(s.gc_stats().sweeps, size_t(1));
+    EXPECT(before - s._pq_size() <= 64 + 10);
+    expect_gc_consistent(s);
+    for (int i = 0; i < 40; ++i) s.tick(1);
+    EXPECT(s._pq_size() < before);
+    EXPECT(s.gc_stats().garbage_ratio() <= 0.25);
+    EXPECT_EQ(s.size(), size_t(1000));
+    expect_gc_consistent(s);
+
+    // 不 tick 时 cancel 也推进增量清理：取消靠后的事件，垃圾占比不会超过阈值太多
+    for (size_t i = 0; i < 1000; ++i)
+        if (i % 100 >= 10) s.cancel(ids[i]);
+    expect_gc_consistent(s);
+    EXPECT_EQ(s.size(), size_t(100));
+    EXPECT(s.gc_stats().sweeps > 1);
+    EXPECT(s.gc_stats().garbage_ratio() <= 0.5);
+    // schedule / cancel 循环中 pq 的大小有上限
+    for (int i = 0; i < 20000; ++i) s.cancel(s.schedule(5000 + i % 1000, [] {}));
+    EXPECT(s._pq_size() < 400);
+    expect_gc_consistent(s);
+
+    // delay 产生的旧节点同样计入（堆顶 ids[0] 不动，否则旧节点会马上出堆）
+    for (size_t i = 1; i < 10; ++i) s.delay(ids[i], 5);
+    EXPECT_EQ(s.gc_stats().stale, size_t(9));
+    expect_gc_consistent(s);
+
+    // 随机操作后统计仍然准确
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (int step = 0; step < 3000; ++step) {
+        int op = dist(rng);
+        EventID id = ids[static_cast<size_t>(dist(rng)) * ids.size() / 100];
+        if (op < 40) ids.push_back(s.schedule(dist(rng), [] {}, TimeMode::Relative, EventType::Repeat, 7));
+        else if (op < 70) s.cancel(id);
+        else if (op < 90 && s.is_alive(id)) s.delay(id, dist(rng) - 50);
+        else s.tick(dist(rng) / 10);
+        if (step % 100 == 0) expect_gc_consistent(s);
+    }
+    expect_gc_consistent(s);
+
+    // budget = 0 时退回到 cancel 中同步重建
+    S t;
+    t.set_gc_policy(es::GcPolicy{.budget = 0});
+    std::vector<EventID> tids;
+    for (int i = 0; i < 10; ++i) tids.push_back(t.schedule(100 - i, [] {}));
+    for (size_t i = 0; i < 6; ++i) t.cancel(tids[i]);
+    EXPECT_EQ(t._pq_size(), size_t(4));
+    EXPECT_EQ(t.gc_stats().garbage(), size_t(0));
+}
+
+// 28) 分层队列：远期事件不进入堆，堆的大小只与近期事件有关，触发顺序与单层队列相同
+template <typename S> static void test_tiered_queue() {
+    S s;
+    Scheduler ref;
+    // 少量近期事件加大量远期事件（小时级）
+    for (int i = 0; i < 20; ++i) {
+        s.schedule(i * 10, [] {});
+        ref.schedule(i * 10, [] {});
+    }
+    for (int i = 0; i < 5000; ++i) {
+        TimeMs t = 3'600'000 + (i * 7919) % 100'000;
+        s.schedule(t, [] {});
+        ref.schedule(t, [] {});
+    }
+    EXPECT(s._pq_heap_size() <= 20);
+    EXPECT(s._pq_overflow_size() >= 5000);
+    EXPECT(s.next_deadline() == ref.next_deadline());
+    EXPECT_EQ(s.due_count(3'650'000), ref.due_count(3'650'000));
+    s.clear();
+    ref.clear();
+
+    // overflow 中最早的节点被清理掉之后，迁移仍然以剩余节点中最早的时刻为起点
+    {
+        S t;
+        t.set_gc_policy(es::GcPolicy{.budget = 0});
+        t.schedule(0, [] {});
+        std::vector<EventID> early;
+        for (int i = 0; i < 4; ++i) early.push_back(t.schedule(1000 + i, [] {}));
+        t.schedule(5000, [] {});
+        t.schedule(5010, [] {});
+        for (EventID id : early) t.cancel(id); // 第 4 次 cancel 时 cancelled > alive，同步重建
+        EXPECT_EQ(t.gc_stats().cancelled, size_t(0));
+        t.tick(1);
+        EXPECT_EQ(*t.next_deadline(), TimeMs(5000));
+        EXPECT_EQ(t._pq_overflow_size(), size_t(0));
+        EXPECT_EQ(t.size(), size_t(2));
+    }
+
+    // 随机 schedule / cancel / delay，与单层队列比较触发顺序
+    std::vector<std::string> got, want;
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> dist(0, 99);
+    std::vector<EventID> ids, ref_ids;
+    for (int step = 0; step < 4000; ++step) {
+        int op = dist(rng);
+        int arg = dist(rng);
+        size_t i = static_cast<size_t>(arg) * ids.size() / 100;
+        if (op < 45) {
+            TimeMs t = op < 10 ? 1000 + arg * 50 : arg;
+            EventType type = op % 9 == 0 ? EventType::Repeat : EventType::Once;
+            ids.push_back(s.schedule(t, [&got, step] { got.push_back(std::to_string(step)); }, TimeMode::Relative, type, 30));
+            ref_ids.push_back(
+                ref.schedule(t, [&want, step] { want.push_back(std::to_string(step)); }, TimeMode::Relative, type, 30));
+        } else if (op < 60 && !ids.empty()) {
+            s.cancel(ids[i]);
+            ref.cancel(ref_ids[i]);
+        } else if (op < 75 && !ids.empty()) {
+            if (s.is_alive(ids[i])) s.delay(ids[i], arg * 20 - 500);
+            if (ref.is_alive(ref_ids[i])) ref.delay(ref_ids[i], arg * 20 - 500);
+        } else {
+            s.tick(arg / 5);
+            ref.tick(arg / 5);
+        }
+        EXPECT(s.next_deadline() == ref.next_deadline());
+    }
+    s.tick(10'000);
+    ref.tick(10'000);
+    EXPECT(got == want);
+    EXPECT(!got.empty());
+}
+
+// 29) 批量 run：预先加载的事件排序一次后按顺序触发，运行中 schedule / cancel / delay 的结果与逐个出堆时相同
+template <typename S> static std::vector<int64_t> batch_run_script(size_t *first_heap = nullptr) {
+    S s;
+    std::vector<int64_t> log;
+    std::vector<EventID> ids;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<TimeMs> when(0, 20'000);
+    std::uniform_int_distribution<int> pri(0, 3);
+    std::function<void(int)> on_fire = [&](int i) {
+        log.push_back(i);
+        log.push_back(s.now());
+        log.push_back(s.next_deadline().value_or(-1));
+        log.push_back(static_cast<int64_t>(s.due_count(s.now() + 20)));
+        if (first_heap && log.size() == 4) *first_heap = s._pq_heap_size();
+        if (i % 7 == 0 && i < 100'000)
+            s.schedule(i % 13, [&on_fire, i] { on_fire(i + 100'000); }, TimeMode::Relative, EventType::Once, 0,
+                       ExceptionPolicy::Swallow, i % 4);
+        if (i % 11 == 0) s.cancel(ids[static_cast<size_t>(i * 31) % ids.size()]);
+        size_t d = static_cast<size_t>(i * 37) % ids.size();
+        if (i % 17 == 0 && s.is_alive(ids[d])) s.delay(ids[d], 50);
+    };
+    for (int i = 0; i < 20'000; ++i)
+        ids.push_back(s.schedule(when(rng), [&on_fire, i] { on_fire(i); }, TimeMode::Relative, EventType::Once, 0,
+                                 ExceptionPolicy::Swallow, pri(rng)));
+    s.run();
+    EXPECT_EQ(s._pq_sorted_size(), size_t(0));
+    log.push_back(static_cast<int64_t>(s.size())); // tick 中的 schedule 在 run 结束时才加入
+    s.run();
+    log.push_back(static_cast<int64_t>(s.size()));
+    return log;
+}
+
+template <es::SchedulerTraits Traits> static void test_batch_run() {
+    size_t first_heap = 1;
+    auto got = batch_run_script<es::EventScheduler<es::DefaultCallback, Traits>>(&first_heap);
+    auto want = batch_run_script<Scheduler>();
+    EXPECT(got == want);
+    EXPECT_EQ(first_heap, size_t(0)); // 预先加载的事件都在 sorted 中，堆里只有运行中 delay 的事件
+}
+
+// 30) 保守并行模拟：LP 之间互相发送消息，结果与线程数、分段运行无关
+struct PdesRing {
+    using Sim = es::ConservativeSimulation<>;
+    static constexpr TimeMs kLookahead = 5;
+
+    Sim sim;
+    std::vector<std::vector<int64_t>> logs;
+
+    PdesRing(size_t n, size_t threads) : sim(n, kLookahead, threads), logs(n) {
+        for (int id = 0; id < 64; ++id) {
+            size_t lp = static_cast<size_t>(id) % n;
+            sim.lp(lp).schedule(id % 7, [this, lp, id] { token(lp, id, 40); });
+        }
+    }
+
+    void token(size_t lp, int id, int hops) {
+        Sim::Scheduler &s = sim.lp(lp);
+        logs[lp].push_back(s.now() * 1000 + id);
+        if (id % 5 == 0) s.schedule(1, [this, lp, id] { logs[lp].push_back(-(sim.lp(lp).now() * 1000 + id)); });
+        if (hops == 0) return;
+        size_t dst = (lp + 1 + static_cast<size_t>(id) % 3) % sim.num_lps();
+        // 不同发送方的消息经常落在同一时刻，检验投递顺序
+        sim.send(lp, dst, s.now() + kLookahead + id % 2, [this, dst, id, hops] { token(dst, id, hops - 1); });
+    }
+};
+
+static void test_conservative_pdes() {
+    PdesRing seq(6, 1);
+    seq.sim.run_until(1000);
+    EXPECT_EQ(seq.sim.messages_delivered(), size_t(64 * 40));
+    for (size_t i = 0; i < 6; ++i) {
+        EXPECT_EQ(seq.sim.lp(i).now(), TimeMs(1000));
+        EXPECT(std::is_sorted(seq.logs[i].begin(), seq.logs[i].end(),
+                              [](int64_t l, int64_t r) { return std::abs(l) / 1000 < std::abs(r) / 1000; }));
+    }
+
+    PdesRing par(6, 4);
+    EXPECT_EQ(par.sim.num_threads(), size_t(4));
+    par.sim.run_until(1000);
+    EXPECT(par.logs == seq.logs);
+    EXPECT_EQ(par.sim.windows(), seq.sim.windows());
+
+    // 分两段运行时窗口在 97 处被截断，同一时刻的事件顺序可能不同，但触发的事件和时间相同
+    PdesRing split(6, 3);
+    split.sim.run_until(97);
+    EXPECT_EQ(split.sim.now(), TimeMs(97));
+    split.sim.run_until(1000);
+    for (size_t i = 0; i < 6; ++i) {
+        auto a = split.logs[i], b = seq.logs[i];
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        EXPECT(a == b);
+    }
+}
+
+// 31) Time Warp：乐观执行中回滚、反消息和 GVT 回收之后，结果与不回滚的执行相同
+struct TimeWarpState {
+    std::vector<int64_t> log;
+    uint64_t sum = 0;
+};
+
+template <typename Storage = es::DynamicStorage<>> struct TimeWarpRing {
+    using State = TimeWarpState;
+    using Sim = es::OptimisticSimulation<State, es::DefaultCallback, es::SchedulerTraits{.deterministic = true}, Storage>;
+
+    Sim sim;
+
+    TimeWarpRing(size_t n, TimeMs optimism, size_t threads) : sim(n, optimism, threads) {
+        for (int id = 0; id < 48; ++id) {
+            size_t lp = static_cast<size_t>(id) % n;
+            sim.lp(lp).schedule(id % 5, [this, lp, id] { token(lp, id, 30); });
+        }
+        sim.send(0, n - 1, 3, [this, n] { token(n - 1, 99, 30); }); // 模拟开始前发送的消息
+    }
+
+    void token(size_t lp, int id, int hops) {
+        typename Sim::Scheduler &s = sim.lp(lp);
+        State &st = sim.state(lp);
+        st.log.push_back(s.now() * 1000 + id);
+        st.sum = st.sum * 31 + static_cast<uint64_t>(id); // 与到达顺序有关
+        if (id % 4 == 0) s.schedule(2, [this, lp, id] { sim.state(lp).log.push_back(-(sim.lp(lp).now() * 1000 + id)); });
+        if (hops == 0) return;
+        // 稀疏的 LP 会远远跑在前面，收到 straggler 后回滚
+        size_t dst = (lp * 7 + static_cast<size_t>(id)) % sim.num_lps();
+        TimeMs ts = s.now() + 1 + (id * 13 + hops) % 9;
+        sim.send(lp, dst, ts, [this, dst, id, hops] { token(dst, id, hops - 1); });
+    }
+};
+
+static void test_time_warp() {
+    // optimism 为 1 时每轮只执行 GVT 时刻的事件，不会回滚
+    TimeWarpRing<> ref(5, 1, 1);
+    ref.sim.run_until(2000);
+    EXPECT_EQ(ref.sim.rollbacks(), size_t(0));
+    EXPECT(ref.sim.gvt() > 2000);
+
+    TimeWarpRing<> opt(5, 1000, 1);
+    opt.sim.run_until(2000);
+    EXPECT(opt.sim.rollbacks() > 0);
+    EXPECT(opt.sim.anti_messages() > 0);
+    EXPECT_EQ(opt.sim.steps() - opt.sim.steps_rolled_back(), ref.sim.steps());
+
+    TimeWarpRing<> par(5, 1000, 4);
+    par.sim.run_until(700);
+    par.sim.run_until(2000);
+
+    // 写时复制的检查点只共享块，结果相同
+    TimeWarpRing<es::CowStorage<16>> cow(5, 1000, 4);
+    cow.sim.run_until(2000);
+    EXPECT(cow.sim.rollbacks() > 0);
+
+    for (size_t i = 0; i < 5; ++i) {
+        EXPECT(!ref.sim.state(i).log.empty());
+        EXPECT(opt.sim.state(i).log == ref.sim.state(i).log);
+        EXPECT_EQ(opt.sim.state(i).sum, ref.sim.state(i).sum);
+        EXPECT(par.sim.state(i).log == ref.sim.state(i).log);
+        EXPECT(cow.sim.state(i).log == ref.sim.state(i).log);
+        EXPECT_EQ(par.sim.lp(i).now(), TimeMs(2000));
+    }
+}
+
+// 32) 快照：每帧保存一次，回滚若干帧后重新执行，与保存时拷贝的完整调度器逐帧比较
+static std::vector<int64_t> *g_snapshot_log = nullptr; // 回调写入当前正在比较的日志，拷贝出来的调度器也能用
+
+static void snapshot_frame(SnapshotScheduler &s, std::vector<EventID> &ids, es::GroupID g, int frame) {
+    std::mt19937 rng(static_cast<uint32_t>(frame));
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (int k = 0; k < 20; ++k) {
+        int op = dist(rng), arg = dist(rng);
+        int64_t tag = frame * 100 + k;
+        auto cb = [tag] { g_snapshot_log->push_back(tag); };
+        size_t pick = static_cast<size_t>(arg) * ids.size() / 100;
+        if (op < 40) {
+            EventType type = op % 5 == 0 ? EventType::Repeat : EventType::Once;
+            ids.push_back(s.schedule(arg, cb, TimeMode::Relative, type, 7 + arg % 20));
+        } else if (op < 50) {
+            ids.push_back(s.schedule_in(g, arg, cb));
+        } else if (op < 65 && !ids.empty()) {
+            s.cancel(ids[pick]);
+        } else if (op < 75 && !ids.empty()) {
+            if (s.is_alive(ids[pick])) s.delay(ids[pick], arg - 50);
+        } else if (op < 78) {
+            s.pause_group(g);
+        } else if (op < 81) {
+            s.resume_group(g);
+        }
+    }
+    if (frame == 30) s.clear();
+    s.tick(16);
+}
+
+static void test_snapshot_rollback() {
+    SnapshotScheduler s;
+    es::GroupID g = s.create_group();
+    std::vector<EventID> ids;
+    std::vector<SnapshotScheduler> copies;
+    std::vector<std::vector<EventID>> ids_at;
+    std::vector<SnapshotScheduler::StateId> state_at;
+    std::vector<int64_t> log, ref_log;
+    g_snapshot_log = &log;
+
+    auto begin_frame = [&] {
+        copies.push_back(s);
+        ids_at.push_back(ids);
+        state_at.push_back(s.save_state());
+    };
+    for (size_t frame = 0; frame < 80; ++frame) {
+        begin_frame();
+        if (frame >= 8) s.release_states_before(state_at[frame - 8]);
+        EXPECT(s.num_states() <= 9);
+        snapshot_frame(s, ids, g, static_cast<int>(frame));
+        if (frame % 10 != 9) continue;
+
+        // 回滚 1 ~ 8 帧，与当时的完整拷贝同步重新执行，重新执行时照常每帧保存
+        size_t from = frame - frame / 10 % 8;
+        s.restore_state(state_at[from]);
+        SnapshotScheduler ref = copies[from];
+        ids = ids_at[from];
+        std::vector<EventID> ref_ids = ids;
+        copies.resize(from + 1, ref);
+        ids_at.resize(from + 1);
+        state_at.resize(from + 1);
+        EXPECT_EQ(s.now(), ref.now());
+        for (size_t f = from; f <= frame; ++f) {
+            if (f > from) begin_frame();
+            log.clear();
+            ref_log.clear();
+            snapshot_frame(s, ids, g, static_cast<int>(f));
+            g_snapshot_log = &ref_log;
+            snapshot_frame(ref, ref_ids, g, static_cast<int>(f));
+            g_snapshot_log = &log;
+            EXPECT(log == ref_log);
+            EXPECT(ids == ref_ids);
+            EXPECT_EQ(s.size(), ref.size());
+            EXPECT(s.next_deadline() == ref.next_deadline());
+            EXPECT_EQ(s.due_count(s.now() + 100), ref.due_count(ref.now() + 100));
+            EXPECT_EQ(s.group_size(g), ref.group_size(g));
+        }
+    }
+    EXPECT(!log.empty());
+    g_snapshot_log = nullptr;
+}
+
+// 33) 写时复制 fork：各分支并行推演互不影响，结果与完整拷贝相同；未修改的块仍然共享
+static thread_local std::vector<int64_t> *g_fork_log = nullptr;
+
+template <typename S> static void fork_ops(S &s, std::vector<EventID> &ids, uint32_t seed, int frames) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (int frame = 0; frame < frames; ++frame) {
+        for (int k = 0; k < 10; ++k) {
+            int op = dist(rng), arg = dist(rng);
+            int64_t tag = static_cast<int64_t>(seed) * 10000 + frame * 100 + k;
+            size_t pick = static_cast<size_t>(arg) * ids.size() / 100;
+            if (op < 50) ids.push_back(s.schedule(arg, [tag] { g_fork_log->push_back(tag); }));
+            else if (op < 75 && !ids.empty()) s.cancel(ids[pick]);
+            else if (!ids.empty() && s.is_alive(ids[pick])) s.delay(ids[pick], arg - 50);
+        }
+        s.tick(10);
+    }
+}
+
+static void test_fork() {
+    CowScheduler base;
+    Scheduler ref;
+    std::vector<EventID> ids, ref_ids;
+    std::vector<int64_t> log, ref_log;
+    for (int i = 0; i < 100; ++i) {
+        base.schedule(100'000 + i, [] {});
+        ref.schedule(100'000 + i, [] {});
+    }
+    g_fork_log = &log;
+    fork_ops(base, ids, 1, 50);
+    g_fork_log = &ref_log;
+    fork_ops(ref, ref_ids, 1, 50);
+    EXPECT(log == ref_log);
+    EXPECT(base._events().size() > 100);
+
+    // fork 之后共享所有块，修改一个事件只复制它所在的块
+    CowScheduler probe = base.fork();
+    EXPECT(&probe._events()[0] == &base._events()[0]);
+    EventID last = ids.back();
+    if (probe.is_alive(last)) probe.delay(last, 1);
+    else last = probe.schedule(1000, [] {});
+    EXPECT(&probe._events()[last.index] != &base._events()[last.index]);
+    EXPECT(&probe._events()[0] == &base._events()[0] || last.index < 16);
+
+    constexpr uint32_t kBranches = 8;
+    std::vector<std::vector<int64_t>> logs(kBranches), ref_logs(kBranches);
+    std::vector<std::vector<EventID>> branch_ids(kBranches, ids), ref_branch_ids(kBranches, ref_ids);
+    std::vector<CowScheduler> forks;
+    for (uint32_t b = 0; b < kBranches; ++b) forks.push_back(base.fork());
+    std::vector<std::thread> threads;
+    for (uint32_t b = 0; b < kBranches; ++b)
+        threads.emplace_back([&, b] {
+            g_fork_log = &logs[b];
+            fork_ops(forks[b], branch_ids[b], 100 + b, 30);
+        });
+    for (std::thread &t : threads) t.join();
+    for (uint32_t b = 0; b < kBranches; ++b) {
+        Scheduler copy = ref;
+        g_fork_log = &ref_logs[b];
+        fork_ops(copy, ref_branch_ids[b], 100 + b, 30);
+        EXPECT(!logs[b].empty());
+        EXPECT(logs[b] == ref_logs[b]);
+        EXPECT(branch_ids[b] == ref_branch_ids[b]);
+        EXPECT_EQ(forks[b].size(), copy.size());
+        EXPECT(forks[b].next_deadline() == copy.next_deadline());
+    }
+
+    // 原调度器不受分支影响
+    log.clear();
+    ref_log.clear();
+    g_fork_log = &log;
+    fork_ops(base, ids, 2, 30);
+    g_fork_log = &ref_log;
+    fork_ops(ref, ref_ids, 2, 30);
+    EXPECT(log == ref_log);
+    EXPECT(ids == ref_ids);
+    EXPECT_EQ(base.size(), ref.size());
+    g_fork_log = nullptr;
+}
+
+// 34) 按 key 调度：与在外部维护 key -> EventID 的做法逐步比较；同一 tick 中对同一 key 重复替换时最后一次生效
+struct ManualKeys {
+    Scheduler s;
+    std::unordered_map<uint64_t, EventID> ids;
+
+    template <typename F> void replace(uint64_t key, TimeMs t, F &&f, EventType type, TimeMs interval) {
+        auto it = ids.find(key);
+        if (it != ids.end()) s.cancel(it->second);
+        ids[key] = s.schedule(t, std::forward<F>(f), TimeMode::Relative, type, interval);
+    }
+    bool cancel(uint64_t key) {
+        auto it = ids.find(key);
+        return it != ids.end() && s.cancel(it->second);
+    }
+    EventID find(uint64_t key) const {
+        auto it = ids.find(key);
+        return it != ids.end() && s.is_alive(it->second) ? it->second : EventID::invalid();
+    }
+    // clear 之后 gen 重新开始，旧的 EventID 可能与新事件相同，外部的表也要清空
+    void clear() {
+        s.clear();
+        ids.clear();
+    }
+    void compact() {
+        s.compact([this](EventID from, EventID to) {
+            for (auto &kv : ids)
+                if (kv.second == from) kv.second = to;
+        });
+    }
+};
+
+struct NativeKeys {
+    KeyedScheduler s;
+
+    template <typename F> void replace(uint64_t key, TimeMs t, F &&f, EventType type, TimeMs interval) {
+        s.schedule_or_replace(key, t, std::forward<F>(f), TimeMode::Relative, type, interval);
+    }
+    bool cancel(uint64_t key) { return s.cancel_by_key(key); }
+    EventID find(uint64_t key) const { return s.find(key); }
+    void clear() { s.clear(); }
+    void compact() { s.compact(); }
+};
+
+template <typename K> static void keyed_script(K &k, std::vector<int64_t> &log, std::vector<EventID> &found) {
+    std::mt19937 rng(23);
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (int step = 0; step < 3000; ++step) {
+        int op = dist(rng), arg = dist(rng);
+        uint64_t key = static_cast<uint64_t>(arg % 40);
+        if (op < 45) {
+            EventType type = op % 6 == 0 ? EventType::Repeat : EventType::Once;
+            bool again = op % 3 == 0; // 触发时用同一个 key 重新调度
+            k.replace(
+                key, arg / 4,
+                [&k, &log, key, step, again] {
+                    log.push_back(step);
+                    if (again) k.replace(key, 5 + step % 20, [&log, step] { log.push_back(-step); }, EventType::Once, 0);
+                },
+                type, 3 + arg % 10);
+        } else if (op < 60) {
+            log.push_back(k.cancel(key) ? 1 : 0);
+        } else if (op < 95) {
+            k.s.tick(1 + arg % 8);
+        } else if (op < 98) {
+            k.compact();
+        } else {
+            k.clear();
+        }
+        found.push_back(k.find(key));
+    }
+}
+
+static void test_keyed_scheduling() {
+    ManualKeys manual;
+    NativeKeys native;
+    std::vector<int64_t> log, ref_log;
+    std::vector<EventID> found, ref_found;
+    keyed_script(manual, ref_log, ref_found);
+    keyed_script(native, log, found);
+    EXPECT(log == ref_log);
+    EXPECT(found == ref_found);
+    size_t live = 0;
+    for (uint64_t key = 0; key < 40; ++key) {
+        EXPECT(native.find(key) == manual.find(key));
+        if (manual.find(key).is_valid()) ++live;
+    }
+    EXPECT_EQ(native.s.num_keys(), live);
+
+    // 同一 tick 中两次替换同一个 key：两个新事件在 tick 结束时依次生效，后一个取代前一个
+    KeyedScheduler s;
+    std::vector<int> fired;
+    s.schedule(10, [&] { s.schedule_or_replace(7, 5, [&] { fired.push_back(1); }); });
+    s.schedule(10, [&] { s.schedule_or_replace(7, 5, [&] { fired.push_back(2); }); });
+    s.tick(10);
+    EXPECT_EQ(s.num_keys(), size_t(1));
+    EXPECT_EQ(s.size(), size_t(1));
+    EventID id = s.find(7);
+    EXPECT(s.is_alive(id));
+    s.tick(5);
+    EXPECT(fired == std::vector<int>{2});
+    EXPECT(!s.find(7).is_valid());
+    EXPECT_EQ(s.num_keys(), size_t(0));
+
+    // Repeat 事件一直占用 key，cancel 后解除
+    EventID rep = s.schedule_or_replace(8, 1, [] {}, TimeMode::Relative, EventType::Repeat, 1);
+    s.tick(5);
+    EXPECT(s.find(8) == rep);
+    EXPECT(s.cancel(rep));
+    EXPECT(!s.find(8).is_valid());
+    EXPECT(!s.cancel_by_key(8));
+}
+
+// 35) 按时间窗口查询：结果与逐个检查事件的结果相同，按触发顺序排列，与之后实际的触发顺序一致
+template <typename S> static void test_range_query() {
+    S s;
+    std::mt19937 rng(31);
+    std::uniform_int_distribution<int> dist(0, 199);
+    std::vector<EventID> ids;
+    std::vector<size_t> fired; // 触发的事件在 ids 中的下标
+    es::GroupID g = s.create_group();
+    for (int i = 0; i < 2000; ++i) {
+        int op = dist(rng), arg = dist(rng);
+        size_t pick = ids.empty() ? 0 : static_cast<size_t>(arg) * ids.size() / 200;
+        if (op < 100) {
+            ids.push_back(s.schedule(arg, [&fired, n = ids.size()] { fired.push_back(n); }));
+        } else if (op < 120) {
+            ids.push_back(s.schedule_in(g, arg, [&fired, n = ids.size()] { fired.push_back(n); }));
+        } else if (op < 150) {
+            s.cancel(ids[pick]);
+        } else if (op < 180) {
+            if (s.is_alive(ids[pick])) s.delay(ids[pick], arg - 100);
+        } else if (op < 185) {
+            if (op % 2) s.pause_group(g);
+            else s.resume_group(g);
+        } else if (op < 190) {
+            s.tick(arg % 7);
+        }
+    }
+
+    for (TimeMs from : {s.now(), s.now() + 37, s.now() + 150}) {
+        TimeMs until = from + 60;
+        std::vector<std::pair<EventID, TimeMs>> got;
+        s.for_each_between(from, until, [&](EventID id, TimeMs t) { got.emplace_back(id, t); });
+        std::vector<EventID> expect;
+        for (EventID id : ids) {
+            if (!s.is_alive(id)) continue;
+            const auto &e = s._event_of(id);
+            if (e.status == es::EventStatus::Alive && e.next_fire >= from && e.next_fire < until) expect.push_back(id);
+        }
+        EXPECT_EQ(got.size(), expect.size());
+        EXPECT_EQ(s.count_between(from, until), expect.size());
+        for (size_t i = 0; i < got.size(); ++i) {
+            EXPECT_EQ(got[i].second, s._event_of(got[i].first).next_fire);
+            if (i > 0) EXPECT(got[i - 1].second <= got[i].second);
+            EXPECT(std::find(expect.begin(), expect.end(), got[i].first) != expect.end());
+        }
+    }
+
+    // f 返回 false 时提前结束
+    size_t visited = 0;
+    s.for_each_between(s.now(), s.now() + 1000, [&](EventID, TimeMs) { return ++visited < 3; });
+    EXPECT(visited <= 3);
+
+    // 与之后实际的触发顺序一致。负的 delay 可能让事件早于 now()，下一次 tick 时同样会触发
+    std::vector<size_t> order;
+    s.for_each_between(std::numeric_limits<TimeMs>::min(), s.now() + 100, [&](EventID id, TimeMs) {
+        order.push_back(static_cast<size_t>(std::find(ids.begin(), ids.end(), id) - ids.begin()));
+    });
+    fired.clear();
+    s.tick(99);
+    EXPECT(fired == order);
+}
+
+// 36) 负载平滑：同一时刻调度的大量 Repeat 定时器的首次触发分散到窗口内，并避开一个周期之前已经拥挤的相位
+static void test_load_smoothing() {
+    // 每次 tick 1ms，统计 [from, until) 内每 ms 的触发数
+    auto fires_per_ms = [](Scheduler &s, int &fired, TimeMs until) {
+        std::vector<int> counts;
+        while (s.now() < until) {
+            int before = fired;
+            s.tick(1);
+            counts.push_back(fired - before);
+        }
+        return counts;
+    };
+
+    Scheduler plain;
+    int plain_fired = 0;
+    for (int i = 0; i < 1000; ++i)
+        plain.schedule(100, [&plain_fired] { ++plain_fired; }, TimeMode::Relative, EventType::Repeat, 100);
+    std::vector<int> spiky = fires_per_ms(plain, plain_fired, 200);
+    EXPECT_EQ(*std::max_element(spiky.begin(), spiky.end()), 1000);
+
+    Scheduler s;
+    s.set_smoothing_policy({.window = 100});
+    int fired = 0;
+    // 绝对时间不平滑：200 个定时器都在 100 的整数倍触发
+    for (int i = 0; i < 200; ++i) s.schedule_at(100, [&fired] { ++fired; }, EventType::Repeat, 100);
+    s.tick(150);
+    EXPECT_EQ(fired, 200);
+
+    std::vector<EventID> ids;
+    for (int i = 0; i < 800; ++i)
+        ids.push_back(s.schedule_after(0, [&fired] { ++fired; }, EventType::Repeat, 100));
+    for (EventID id : ids) {
+        TimeMs first = s._event_of(id).next_fire;
+        EXPECT(first >= 150 && first < 250);
+        EXPECT(first != 200);
+    }
+
+    std::vector<int> counts = fires_per_ms(s, fired, 500);
+    std::vector<int> steady(counts.begin() + 150, counts.begin() + 250); // 第 i 项是 301 + i ms 的触发数
+    for (size_t i = 0; i < steady.size(); ++i) {
+        if (i == 99) EXPECT_EQ(steady[i], 200);
+        else EXPECT(steady[i] >= 8 && steady[i] <= 9);
+    }
+
+    // window = 0 关闭平滑
+    s.set_smoothing_policy({});
+    EventID id = s.schedule_after(7, [] {}, EventType::Repeat, 100);
+    EXPECT_EQ(s._event_of(id).next_fire, s.now() + 7);
+}
+
+// 37) jitter：每次重新调度追加的延迟不超过 max_ms，相同的种子得到相同的触发时刻，同时启动的心跳逐渐错开
+static void test_jitter() {
+    // 100 个同时启动的心跳，返回每个心跳的触发时刻
+    auto heartbeats = [](uint64_t seed, es::Jitter jitter) {
+        JitterScheduler s;
+        s.seed_jitter(seed);
+        std::vector<std::vector<TimeMs>> fires(100);
+        for (size_t i = 0; i < fires.size(); ++i) {
+            EventID id = s.schedule(100, [&s, &fires, i] { fires[i].push_back(s.now()); }, TimeMode::Relative,
+                                    EventType::Repeat, 100);
+            s.set_jitter(id, jitter);
+        }
+        for (int t = 0; t < 2000; ++t) s.tick(1);
+        return fires;
+    };
+
+    auto fixed = heartbeats(1, {});
+    for (const auto &f : fixed) {
+        EXPECT_EQ(f.size(), 20u);
+        for (size_t k = 0; k < f.size(); ++k) EXPECT_EQ(f[k], static_cast<TimeMs>(100 * (k + 1)));
+    }
+
+    es::Jitter uniform{.kind = es::JitterKind::Uniform, .max_ms = 20};
+    auto a = heartbeats(1, uniform);
+    EXPECT(a == heartbeats(1, uniform));
+    EXPECT(a != heartbeats(2, uniform));
+    std::set<TimeMs> fifth; // 第 5 次触发的时刻
+    for (const auto &f : a) {
+        EXPECT_EQ(f.front(), 100);
+        for (size_t k = 1; k < f.size(); ++k) EXPECT(f[k] - f[k - 1] >= 100 && f[k] - f[k - 1] <= 120);
+        fifth.insert(f[4]);
+    }
+    EXPECT(fifth.size() > 20);
+
+    es::Jitter exponential{.kind = es::JitterKind::Exponential, .max_ms = 50, .mean_ms = 10};
+    TimeMs total = 0;
+    size_t gaps = 0;
+    for (const auto &f : heartbeats(3, exponential)) {
+        for (size_t k = 1; k < f.size(); ++k) {
+            TimeMs gap = f[k] - f[k - 1];
+            EXPECT(gap >= 100 && gap <= 150);
+            total += gap - 100;
+            ++gaps;
+        }
+    }
+    double mean = static_cast<double>(total) / static_cast<double>(gaps);
+    EXPECT(mean > 7 && mean < 11); // 向下取整之后均值约为 9.5
+
+    // max_ms 为 0 的事件不消耗随机数：混入这样的心跳不改变其它心跳的触发时刻；Aligned 事件不受 jitter 影响
+    {
+        JitterScheduler s1, s2;
+        std::vector<TimeMs> f1, f2, aligned;
+        EventID ja = s1.schedule(10, [&] { f1.push_back(s1.now()); }, TimeMode::Relative, EventType::Repeat, 10);
+        EventID jb = s2.schedule(10, [&] { f2.push_back(s2.now()); }, TimeMode::Relative, EventType::Repeat, 10);
+        s1.set_jitter(ja, uniform);
+        s2.set_jitter(jb, uniform);
+        s2.schedule(3, [] {}, TimeMode::Relative, EventType::Repeat, 3);
+        EventID jc = s2.schedule(5, [&] { aligned.push_back(s2.now()); }, TimeMode::Relative, EventType::Repeat, 50);
+        s2.set_repeat_mode(jc, es::RepeatMode::Aligned);
+        s2.set_jitter(jc, uniform);
+        for (int t = 0; t < 1000; ++t) {
+            s1.tick(1);
+            s2.tick(1);
+        }
+        EXPECT(f1 == f2);
+        for (size_t k = 1; k < aligned.size(); ++k) EXPECT_EQ(aligned[k], static_cast<TimeMs>(50 * k));
+    }
+
+    // 默认 jitter 对之后调度的事件生效，快照恢复时 PRNG 状态一起恢复
+    es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.snapshots = true, .jitter = true}> s;
+    s.set_default_jitter(uniform);
+    std::vector<TimeMs> log;
+    s.schedule(10, [&] { log.push_back(s.now()); }, TimeMode::Relative, EventType::Repeat, 10);
+    auto state = s.save_state();
+    for (int t = 0; t < 500; ++t) s.tick(1);
+    std::vector<TimeMs> first = log;
+    log.clear();
+    s.restore_state(state);
+    for (int t = 0; t < 500; ++t) s.tick(1);
+    EXPECT(log == first);
+    EXPECT(first.size() > 20 && first.size() < 50);
+}
+
+// 38) RepeatMode：FixedRate 落后时补上错过的触发，FixedDelay 从回调结束时重新计时，Aligned 对齐到 interval 的整数倍
+static void test_repeat_modes() {
+    Scheduler s;
+    std::vector<TimeMs> rate, delay, aligned;
+    s.schedule(10, [&] { rate.push_back(s.now()); }, TimeMode::Relative, EventType::Repeat, 10);
+    EventID d = s.schedule(10, [&] { delay.push_back(s.now()); }, TimeMode::Relative, EventType::Repeat, 10);
+    s.set_repeat_mode(d, es::RepeatMode::FixedDelay);
+    EventID a = s.schedule(7, [&] { aligned.push_back(s.now()); }, TimeMode::Relative, EventType::Repeat, 100);
+    s.set_repeat_mode(a, es::RepeatMode::Aligned);
+
+    s.tick(35);
+    EXPECT_EQ(rate.size(), 3u);
+    EXPECT_EQ(delay.size(), 1u);
+    EXPECT_EQ(s._event_of(d).next_fire, 45);
+    EXPECT_EQ(aligned.size(), 1u);
+    EXPECT_EQ(s._event_of(a).next_fire, 100);
+    for (int t = 0; t < 300; ++t) s.tick(1);
+    EXPECT(aligned == (std::vector<TimeMs>{35, 100, 200, 300}));
+    EXPECT_EQ(delay.back(), 335);
+
+    // 宿主按实际经过的时间 tick，每次回调耗时 30ms：FixedRate 不断追赶，FixedDelay 从回调结束开始间隔 interval
+    for (es::RepeatMode mode : {es::RepeatMode::FixedRate, es::RepeatMode::FixedDelay}) {
+        Scheduler host;
+        TimeMs wall = 0; // 宿主的时钟，只有回调会让它比 now() 走得更快
+        host.set_run_clock([&] { return wall; });
+        std::vector<TimeMs> fires;
+        EventID id = host.schedule(10, [&] {
+            fires.push_back(host.now());
+            wall += 30;
+        }, TimeMode::Relative, EventType::Repeat, 10);
+        host.set_repeat_mode(id, mode);
+        TimeMs elapsed = 1;
+        size_t max_per_tick = 0;
+        while (host.now() < 1000) {
+            size_t before = fires.size();
+            host.tick(elapsed);
+            size_t n = fires.size() - before;
+            max_per_tick = std::max(max_per_tick, n);
+            elapsed = 1 + 30 * static_cast<TimeMs>(n);
+        }
+        if (mode == es::RepeatMode::FixedRate) {
+            EXPECT(max_per_tick > 3);
+        } else {
+            EXPECT_EQ(max_per_tick, 1u);
+            for (size_t k = 1; k < fires.size(); ++k) EXPECT(fires[k] - fires[k - 1] >= 40);
+        }
+    }
+
+    // 暂停期间错过的 Aligned 触发在恢复后对齐到下一个边界
+    es::GroupID g = s.create_group();
+    EventID ga = s.schedule_in(g, 30, [] {}, TimeMode::Relative, EventType::Repeat, 100);
+    s.set_repeat_mode(ga, es::RepeatMode::Aligned);
+    s.pause_group(g);
+    s.tick(45);
+    s.resume_group(g);
+    EXPECT_EQ(s._event_of(ga).next_fire, 500); // 恢复时距离触发还有 30ms，即 410，顺延到 500
+}
+
+// 39) 日历事件：next_after 与逐日逐分钟检查的结果相同，调度器按日历触发
+static void test_calendar() {
+    using namespace std::chrono;
+    struct Spec {
+        std::set<int> minutes, hours, days, months, weekdays;
+        bool day_star, weekday_star;
+    };
+    // 用 std::chrono 的日历逐日检查，得到严格晚于 t 的下一个匹配时刻
+    auto brute_next = [](const Spec &sp, TimeMs t, TimeMs offset) {
+        TimeMs local = t + offset;
+        sys_days day = floor<days>(sys_time<milliseconds>(milliseconds(local)));
+        for (;; day += days(1)) {
+            year_month_day ymd(day);
+            int wd = static_cast<int>(weekday(day).c_encoding());
+            bool dom = sp.days.count(static_cast<int>(static_cast<unsigned>(ymd.day()))) > 0;
+            bool dow = sp.weekdays.count(wd) > 0;
+            bool day_ok = sp.day_star || sp.weekday_star ? dom && dow : dom || dow;
+            if (!sp.months.count(static_cast<int>(static_cast<unsigned>(ymd.month()))) || !day_ok) continue;
+            for (int h : sp.hours)
+                for (int m : sp.minutes) {
+                    TimeMs at = duration_cast<milliseconds>(day.time_since_epoch() + hours(h) + minutes(m)).count();
+                    if (at > local) return at - offset;
+                }
+        }
+    };
+    auto range = [](int lo, int hi, int step = 1) {
+        std::set<int> r;
+        for (int v = lo; v <= hi; v += step) r.insert(v);
+        return r;
+    };
+    std::vector<std::pair<const char *, Spec>> cases = {
+        {"15 * * * *", {{15}, range(0, 23), range(1, 31), range(1, 12), range(0, 6), true, true}},
+        {"0 0 * * *", {{0}, {0}, range(1, 31), range(1, 12), range(0, 6), true, true}},
+        {"0 9 * * 1-5", {{0}, {9}, range(1, 31), range(1, 12), range(1, 5), true, false}},
+        {"*/7 3,15 1,15 * 5", {range(0, 59, 7), {3, 15}, {1, 15}, range(1, 12), {5}, false, false}},
+        {"0 0 29 2 *", {{0}, {0}, {29}, {2}, range(0, 6), false, true}},
+        {"30 12 31 * *", {{30}, {12}, {31}, range(1, 12), range(0, 6), false, true}},
+        {"5-10/5 22-23 */10 1,6-7 7", {{5, 10}, {22, 23}, range(1, 31, 10), {1, 6, 7}, {0}, true, false}},
+        {"0 0 13 * 5", {{0}, {0}, {13}, range(1, 12), {5}, false, false}},
+    };
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<TimeMs> when(-2'000'000'000'000, 4'000'000'000'000); // 1906 到 2096 年
+    for (TimeMs offset : {TimeMs{0}, TimeMs{8 * 3'600'000}, TimeMs{-(5 * 3'600'000 + 30 * 60'000)}}) {
+        for (const auto &[text, sp] : cases) {
+            std::optional<es::CronExpr> c = es::CronExpr::parse(text, offset);
+            REQUIRE(c.has_value());
+            for (int i = 0; i < 40; ++i) {
+                TimeMs t = when(rng);
+                if (i % 4 == 0) t = t / 60'000 * 60'000; // 整分钟
+                EXPECT_EQ(c->next_after(t), brute_next(sp, t, offset));
+            }
+        }
+    }
+    for (const char *bad : {"60 * * * *", "* 24 * * *", "* * 0 * *", "* * * 13 *", "* * * * 8", "* * * *",
+                            "* * * * * *", "a * * * *", "*/0 * * * *", "5-3 * * * *", "1, * * * *", "* * 30 2 *",
+                            "* * 31 4,6 *"})
+        EXPECT(!es::CronExpr::parse(bad).has_value());
+    EXPECT(es::CronExpr::parse("* * 30 2 1").has_value()); // 日和周满足任一即可
+    EXPECT(es::CronExpr::parse(" 0  0 * *  * ").has_value());
+
+    CalendarScheduler s;
+    es::CalendarId hourly = s.add_calendar(*es::CronExpr::parse("15 * * * *"));
+    es::CalendarId weekly = s.add_calendar(*es::CronExpr::parse("0 9 * * 1"));
+    es::CalendarId daily = s.add_calendar(*es::CronExpr::parse("0 0 * * *", 8 * 3'600'000));
+    EXPECT_EQ(s.add_calendar(*es::CronExpr::parse("15 * * * *")), hourly);
+    EXPECT_EQ(s.num_calendars(), 3u);
+    std::vector<TimeMs> h, w, d;
+    s.schedule_calendar(hourly, [&] { h.push_back(s.now()); });
+    s.schedule_calendar(weekly, [&] { w.push_back(s.now()); });
+    s.schedule_calendar(daily, [&] { d.push_back(s.now()); });
+    constexpr TimeMs minute = 60'000, hour = 60 * minute, day = 24 * hour;
+    for (int i = 0; i < 21 * 24 * 60; ++i) s.tick(minute);
+    EXPECT_EQ(h.size(), 21u * 24u);
+    for (size_t i = 0; i < h.size(); ++i) EXPECT_EQ(h[i], static_cast<TimeMs>(i) * hour + 15 * minute);
+    // 1970-01-01 是周四，之后的周一是 1 月 5 日
+    EXPECT(w == (std::vector<TimeMs>{4 * day + 9 * hour, 11 * day + 9 * hour, 18 * day + 9 * hour}));
+    EXPECT_EQ(d.size(), 21u);
+    EXPECT_EQ(d.front(), 16 * hour); // UTC+8 的零点
+    // 落后时只触发一次，之后回到日历时刻
+    s.tick(5 * hour + 30 * minute);
+    EXPECT_EQ(h.size(), 21u * 24u + 1);
+    s.tick(44 * minute);
+    EXPECT_EQ(h.size(), 21u * 24u + 1);
+    s.tick(minute);
+    EXPECT_EQ(h.back(), 21 * day + 6 * hour + 15 * minute);
+}
+
+// 40) 快照与 GC：没有保留快照时 cancel 的槽位和节点照常回收，保留快照期间留在 pq 中，全部释放后再清理
+static void test_snapshot_gc() {
+    SnapshotScheduler s;
+    EventID keep = s.schedule(1, [] {}); // 堆顶一直是它，cancel 的节点不会被顺带弹出
+    for (int i = 0; i < 20000; ++i) {
+        s.cancel(s.schedule(5000 + i % 1000, [] {}));
+        if (i % 100 == 0) s.tick(0);
+    }
+    EXPECT(s._pq_size() < 400);
+    EXPECT(s._events().size() < 400);
+    expect_gc_consistent(s);
+
+    // 保留快照时 cancel 的节点要留给 restore_state
+    auto id = s.save_state();
+    for (int i = 0; i < 2000; ++i) s.cancel(s.schedule(5000 + i, [] {}));
+    EXPECT(s._pq_size() > 2000);
+    s.cancel(keep);
+    s.restore_state(id);
+    EXPECT(s.is_alive(keep));
+    for (int i = 0; i < 2000; ++i) s.cancel(s.schedule(5000 + i, [] {}));
+    s.release_states_before(id + 1);
+    EXPECT_EQ(s.num_states(), size_t(0));
+    for (int i = 0; i < 100; ++i) s.tick(0);
+    EXPECT(s._pq_size() < 400);
+    expect_gc_consistent(s);
+
+    // 关闭增量清理时释放快照后同步重建
+    SnapshotScheduler t;
+    t.set_gc_policy(es::GcPolicy{.budget = 0});
+    t.schedule(1, [] {});
+    auto tid = t.save_state();
+    for (int i = 0; i < 100; ++i) t.cancel(t.schedule(5000 + i, [] {}));
+    EXPECT_EQ(t._pq_size(), size_t(101));
+    t.release_states_before(tid + 1);
+    EXPECT_EQ(t._pq_size(), size_t(1));
+    EXPECT_EQ(t.size(), size_t(1));
+    for (int i = 0; i < 100; ++i) t.cancel(t.schedule(5000 + i, [] {}));
+    EXPECT(t._events().size() < 110);
+}
+
 int main() {
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
 
     test_basic_order_and_tie_break();
+    test_basic_order_and_tie_break<StaticScheduler>();
+    test_basic_order_and_tie_break<BucketScheduler>();
+    test_basic_order_and_tie_break<TieredScheduler>();
+    test_basic_order_and_tie_break<SnapshotScheduler>();
+    test_basic_order_and_tie_break<CowScheduler>();
     test_absolute_time();
+    test_absolute_time<StaticScheduler>();
+    test_absolute_time<BucketScheduler>();
+    test_absolute_time<TieredScheduler>();
+    test_absolute_time<SnapshotScheduler>();
+    test_absolute_time<CowScheduler>();
     test_priority_order();
+    test_priority_order<StaticScheduler>();
+    test_priority_order<BucketScheduler>();
+    test_priority_order<TieredScheduler>();
+    test_priority_order<SnapshotScheduler>();
+    test_priority_order<CowScheduler>();
     test_tick0_semantics_and_schedule_during_tick();
+    test_tick0_semantics_and_schedule_during_tick<StaticScheduler>();
+    test_tick0_semantics_and_schedule_during_tick<BucketScheduler>();
+    test_tick0_semantics_and_schedule_during_tick<TieredScheduler>();
+    test_tick0_semantics_and_schedule_during_tick<SnapshotScheduler>();
+    test_tick0_semantics_and_schedule_during_tick<CowScheduler>();
     test_cancel_self_in_callback_repeat();
+    test_cancel_self_in_callback_repeat<StaticScheduler>();
+    test_cancel_self_in_callback_repeat<BucketScheduler>();
+    test_cancel_self_in_callback_repeat<TieredScheduler>();
+    test_cancel_self_in_callback_repeat<SnapshotScheduler>();
+    test_cancel_self_in_callback_repeat<CowScheduler>();
     test_exception_policy_swallow_and_cancel_event();
+    test_exception_policy_swallow_and_cancel_event<StaticScheduler>();
+    test_exception_policy_swallow_and_cancel_event<BucketScheduler>();
+    test_exception_policy_swallow_and_cancel_event<TieredScheduler>();
+    test_exception_policy_swallow_and_cancel_event<SnapshotScheduler>();
+    test_exception_policy_swallow_and_cancel_event<CowScheduler>();
     test_pause_resume();
+    test_pause_resume<StaticScheduler>();
+    test_pause_resume<BucketScheduler>();
+    test_pause_resume<TieredScheduler>();
+    test_pause_resume<SnapshotScheduler>();
+    test_pause_resume<CowScheduler>();
     test_rebuild_and_generation_safety();
+    test_rebuild_and_generation_safety<StaticScheduler>();
+    test_rebuild_and_generation_safety<BucketScheduler>();
+    test_rebuild_and_generation_safety<TieredScheduler>();
+    test_rebuild_and_generation_safety<SnapshotScheduler>();
+    test_rebuild_and_generation_safety<CowScheduler>();
     test_clear_resets();
+    test_clear_resets<StaticScheduler>();
+    test_clear_resets<BucketScheduler>();
+    test_clear_resets<TieredScheduler>();
+    test_clear_resets<SnapshotScheduler>();
+    test_clear_resets<CowScheduler>();
     test_fuzz_once_only();
+    test_fuzz_once_only<StaticScheduler>();
+    test_fuzz_once_only<BucketScheduler>();
+    test_fuzz_once_only<TieredScheduler>();
+    test_fuzz_once_only<SnapshotScheduler>();
+    test_fuzz_once_only<CowScheduler>();
     test_rethrow();
+    test_rethrow<StaticScheduler>();
+    test_rethrow<BucketScheduler>();
+    test_rethrow<TieredScheduler>();
+    test_rethrow<SnapshotScheduler>();
+    test_rethrow<CowScheduler>();
     test_clear_then_schedule_in_same_tick();
+    test_clear_then_schedule_in_same_tick<StaticScheduler>();
+    test_clear_then_schedule_in_same_tick<BucketScheduler>();
+    test_clear_then_schedule_in_same_tick<TieredScheduler>();
+    test_clear_then_schedule_in_same_tick<SnapshotScheduler>();
+    test_clear_then_schedule_in_same_tick<CowScheduler>();
     test_double_clear_then_schedule_in_same_tick();
+    test_double_clear_then_schedule_in_same_tick<StaticScheduler>();
+    test_double_clear_then_schedule_in_same_tick<BucketScheduler>();
+    test_double_clear_then_schedule_in_same_tick<TieredScheduler>();
+    test_double_clear_then_schedule_in_same_tick<SnapshotScheduler>();
+    test_double_clear_then_schedule_in_same_tick<CowScheduler>();
     demo_assert_bug_repeat_latest_not_due();
+    test_event_groups();
+    test_event_groups<StaticScheduler>();
+    test_event_groups<BucketScheduler>();
+    test_event_groups<TieredScheduler>();
+    test_event_groups<SnapshotScheduler>();
+    test_event_groups<CowScheduler>();
+    test_timer_slack_coalescing();
+    test_timer_slack_coalescing<StaticScheduler>();
+    test_timer_slack_coalescing<BucketScheduler>();
+    test_timer_slack_coalescing<TieredScheduler>();
+    test_timer_slack_coalescing<SnapshotScheduler>();
+    test_timer_slack_coalescing<CowScheduler>();
+    test_numeric_priority();
+    test_next_deadline_and_due_count();
+    test_next_deadline_and_due_count<StaticScheduler>();
+    test_next_deadline_and_due_count<BucketScheduler>();
+    test_next_deadline_and_due_count<TieredScheduler>();
+    test_next_deadline_and_due_count<SnapshotScheduler>();
+    test_next_deadline_and_due_count<CowScheduler>();
+    test_compact();
+    test_pmr_allocator();
+    test_minimal_traits();
+    test_static_capacity();
+    test_fn_callback();
+    test_handler_registry();
+    test_bucketing();
+    test_deterministic_replay<es::SchedulerTraits{.deterministic = true}>();
+    test_deterministic_replay<es::SchedulerTraits{.deterministic = true, .bucketing = true}>();
+    test_incremental_gc();
+    test_incremental_gc<BucketScheduler>();
+    test_incremental_gc<TieredScheduler>();
+    test_incremental_gc<SnapshotScheduler>();
+    test_incremental_gc<CowScheduler>();
+    test_tiered_queue<TieredScheduler>();
+    test_tiered_queue<es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.bucketing = true, .tier_horizon = 50}>>();
+    test_batch_run<es::SchedulerTraits{.batch_run = true}>();
+    test_batch_run<es::SchedulerTraits{.bucketing = true, .batch_run = true}>();
+    test_batch_run<es::SchedulerTraits{.tier_horizon = 50, .batch_run = true}>();
+    test_conservative_pdes();
+    test_time_warp();
+    test_snapshot_rollback();
+    test_fork();
+    test_keyed_scheduling();
+    test_range_query<Scheduler>();
+    test_range_query<BucketScheduler>();
+    test_range_query<TieredScheduler>();
+    test_range_query<CowScheduler>();
+    test_range_query<SnapshotScheduler>();
+    test_range_query<StaticScheduler>();
+    test_range_query<es::StaticEventScheduler<es::DefaultCallback, 256, es::SchedulerTraits{.bucketing = true}>>();
+    test_range_query<es::EventScheduler<es::DefaultCallback, es::SchedulerTraits{.batch_run = true}>>();
+    test_load_smoothing();
+    test_jitter();
+    test_repeat_modes();
+    test_calendar();
+    test_snapshot_gc();
 
     print_summary();
 
@@ -0,0 +1,444 @@
+// pdes.hpp
+#pragma once
+#include "event.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <barrier>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace es {
+
+// 保守并行离散事件模拟。每个逻辑进程（LP）是一个独立的 EventScheduler，LP 之间只能通过 send 交换带时间戳的消息，
+// 消息的时间戳至少比发送时刻晚 lookahead。
+//
+// 同步方式为窗口屏障：每一轮取所有 LP 中最早的事件时间 T，各线程并行处理自己负责的 LP 中 [T, T + lookahead) 的
+// 事件；这段时间内发出的消息都不早于 T + lookahead，所以不会影响本轮。轮末在屏障处投递消息：发给同一个 LP 的消息按
+// (时间戳, 发送方, 发送顺序) 排序后依次 schedule。LP 使用 deterministic 调度，窗口的划分只取决于模拟本身，所以结果
+// 与线程数和 LP 在线程间的分配无关，与单线程运行完全相同。run_until 的终点会截断窗口，分段运行时同一 LP 中同一时刻
+// 的事件顺序可能与一次运行不同。
+//
+// LP 内部的回调在工作线程中执行，只能访问本 LP 的状态，不能抛出异常（使用 ExceptionPolicy::Swallow）
+template <typename Callback = DefaultCallback, SchedulerTraits Traits = SchedulerTraits{.deterministic = true}>
+class ConservativeSimulation {
+    static_assert(Traits.deterministic, "LP 必须使用 deterministic 调度，否则同一时刻的事件顺序与槽位复用有关");
+
+public:
+    using Scheduler = EventScheduler<Callback, Traits>;
+
+    // threads 为 0 时使用硬件线程数，不会超过 LP 数
+    ConservativeSimulation(size_t num_lps, TimeMs lookahead, size_t threads = 0)
+        : lps(num_lps), outboxes(num_lps * num_lps), lookahead_(lookahead) {
+        assert(num_lps > 0);
+        assert(lookahead > 0);
+        if (threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        threads_ = std::min(threads, num_lps);
+    }
+
+    ConservativeSimulation(const ConservativeSimulation &) = delete;
+    ConservativeSimulation &operator=(const ConservativeSimulation &) = delete;
+
+    size_t num_lps() const noexcept { return lps.size(); }
+    size_t num_threads() const noexcept { return threads_; }
+    TimeMs lookahead() const noexcept { return lookahead_; }
+    TimeMs now() const noexcept { return current; }
+    size_t messages_delivered() const noexcept {
+        size_t n = 0;
+        for (const Lp &p : lps) n += p.received;
+        return n;
+    }
+    size_t windows() const noexcept { return windows_; }
+
+    // LP 的调度器。模拟开始前可以直接 schedule 初始事件；运行中只能在本 LP 的回调里使用
+    Scheduler &lp(size_t i) noexcept { return lps[i].sched; }
+    const Scheduler &lp(size_t i) const noexcept { return lps[i].sched; }
+
+    // 从 src 向 dst 发送消息，在 dst 中于绝对时间 ts 执行 f。运行中只能在 src 的回调里调用，ts 不能早于
+    // src 的当前时间加 lookahead
+    template <typename F> void send(size_t src, size_t dst, TimeMs ts, F &&f) {
+        assert(src < lps.size() && dst < lps.size());
+        assert(ts >= lps[src].sched.now() + lookahead_);
+        Outbox &out = outboxes[src * lps.size() + dst];
+        out.push_back(Message{ts, Callback(std::forward<F>(f))});
+    }
+
+    // 执行所有时间不晚于 end 的事件，之后所有 LP 的时间都是 end
+    void run_until(TimeMs end) {
+        assert(end >= current);
+        deliver_all(); // 模拟开始前 send 的消息
+        if (threads_ == 1) {
+            while (next_window(end)) {
+                for (Lp &p : lps) process(p);
+                deliver_all();
+            }
+        } else {
+            run_parallel(end);
+        }
+        for (Lp &p : lps)
+            if (p.sched.now() < end) p.sched.tick(end - p.sched.now());
+        current = end;
+    }
+
+private:
+    struct Message {
+        TimeMs ts;
+        Callback cb;
+    };
+    using Outbox = std::vector<Message>;
+
+    struct Lp {
+        Scheduler sched;
+        std::vector<Message *> inbox; // 投递时的排序工作区
+        size_t received = 0;
+    };
+
+    // 计算下一轮的窗口，没有需要执行的事件时返回 false
+    bool next_window(TimeMs end) {
+        std::optional<TimeMs> t;
+        for (const Lp &p : lps) {
+            auto d = p.sched.next_deadline();
+            if (d && (!t || *d < *t)) t = d;
+        }
+        if (!t || *t > end) return false;
+        window_end = std::min(*t + lookahead_, end + 1);
+        ++windows_;
+        return true;
+    }
+
+    // 按时间顺序执行窗口内的事件。每次 tick 到最早的事件，回调中 now() 就是事件时间；tick 中 schedule 的事件在下一次
+    // tick 时处理
+    void process(Lp &p) {
+        Scheduler &s = p.sched;
+        for (auto d = s.next_deadline(); d && *d < window_end; d = s.next_deadline()) s.tick(*d - s.now());
+    }
+
+    void deliver(size_t dst) {
+        Lp &p = lps[dst];
+        p.inbox.clear();
+        for (size_t src = 0; src < lps.size(); ++src)
+            for (Message &m : outboxes[src * lps.size() + dst]) p.inbox.push_back(&m);
+        // 收集时已经按 (发送方, 发送顺序) 排列，稳定排序后即 (时间戳, 发送方, 发送顺序)
+        std::stable_sort(p.inbox.begin(), p.inbox.end(), [](const Message *l, const Message *r) { return l->ts < r->ts; });
+        for (Message *m : p.inbox) {
+            assert(m->ts > p.sched.now());
+            p.sched.schedule(m->ts, std::move(m->cb), TimeMode::Absolute);
+        }
+        p.received += p.inbox.size();
+        for (size_t src = 0; src < lps.size(); ++src) outboxes[src * lps.size() + dst].clear();
+    }
+
+    void deliver_all() {
+        for (size_t dst = 0; dst < lps.size(); ++dst) deliver(dst);
+    }
+
+    // 线程 w 负责下标 w, w + threads, ... 的 LP。每一轮三次屏障：公布窗口、执行完毕、投递完毕。0 号线程是调用方，
+    // 在投递完毕后计算下一轮的窗口
+    void run_parallel(TimeMs end) {
+        std::barrier sync(static_cast<std::ptrdiff_t>(threads_));
+        bool stop = false;
+        auto worker = [&](size_t w) {
+            while (true) {
+                if (w == 0) stop = !next_window(end);
+                sync.arrive_and_wait();
+                if (stop) return;
+                for (size_t i = w; i < lps.size(); i += threads_) process(lps[i]);
+                sync.arrive_and_wait();
+                for (size_t i = w; i < lps.size(); i += threads_) deliver(i);
+                sync.arrive_and_wait();
+            }
+        };
+        std::vector<std::thread> pool;
+        pool.reserve(threads_ - 1);
+        for (size_t w = 1; w < threads_; ++w) pool.emplace_back(worker, w);
+        worker(0);
+        for (std::thread &t : pool) t.join();
+    }
+
+    std::vector<Lp> lps;
+    std::vector<Outbox> outboxes; // outboxes[src * n + dst]，只由 src 所在的线程写入，只由 dst 所在的线程读取
+    TimeMs lookahead_;
+    size_t threads_ = 1;
+    TimeMs current{};
+    TimeMs window_end{};
+    size_t windows_{};
+};
+
+} // namespace es
+
+namespace es {
+
+// 乐观并行离散事件模拟（Time Warp）。每个 LP 由一个 EventScheduler 和用户状态 State 组成，各 LP 不等待其它 LP，
+// 只要事件时间不超过 GVT + optimism 就直接执行。每执行一个时刻之前保存检查点（State 和调度器的 fork），收到时间早于
+// 本地进度的消息（straggler）时回滚到该时刻之前的检查点，并为回滚区间内发出的消息发送反消息；收到反消息时删除对应
+// 的消息，若已经执行过则同样回滚。
+//
+// 消息不直接进入调度器，而是保存在 LP 的输入队列中，执行到它的时刻时按 (时间戳, 发送方, 发送顺序) 注入，所以同一
+// 时刻的事件顺序是确定的，结果与线程数、回滚次数无关。GVT 在每一轮结束的屏障处计算，早于 GVT 的检查点和消息被回收。
+//
+// 回调在工作线程中执行，只能通过 state(lp) 访问本 LP 的状态（回滚时状态被整体赋值，引用保持有效），不能抛出异常，
+// 也不能有模拟之外的副作用。Callback 和 State 必须可拷贝。
+//
+// 检查点的开销取决于 Storage：默认的 DynamicStorage 每个时刻完整拷贝一次调度器，与 LP 中的事件数成正比；
+// CowStorage 下 fork 只共享块表，之后只复制这一时刻写到的块。State 总是完整拷贝，较大的状态应自行分块共享
+template <typename State, typename Callback = DefaultCallback,
+          SchedulerTraits Traits = SchedulerTraits{.deterministic = true}, typename Storage = DynamicStorage<>>
+class OptimisticSimulation {
+    static_assert(Traits.deterministic, "LP 必须使用 deterministic 调度，否则同一时刻的事件顺序与槽位复用有关");
+    static_assert(std::is_copy_constructible_v<State> && std::is_copy_constructible_v<Callback>,
+                  "检查点需要拷贝 State 和 Callback");
+
+public:
+    using Scheduler = BasicEventScheduler<Callback, Traits, Storage>;
+
+    // optimism 限制乐观执行的深度：一轮中只执行时间早于 GVT + optimism 的事件。一轮中每个 LP 执行的每个时刻都保存
+    // 一个检查点，optimism 越大，检查点越多，每个检查点的开销见上面关于 Storage 的说明。threads 为 0 时使用硬件线程数
+    OptimisticSimulation(size_t num_lps, TimeMs optimism, size_t threads = 0) : lps(num_lps), optimism_(optimism) {
+        assert(num_lps > 0);
+        assert(optimism > 0);
+        if (threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        threads_ = std::min(threads, num_lps);
+    }
+
+    OptimisticSimulation(const OptimisticSimulation &) = delete;
+    OptimisticSimulation &operator=(const OptimisticSimulation &) = delete;
+
+    size_t num_lps() const noexcept { return lps.size(); }
+    size_t num_threads() const noexcept { return threads_; }
+    TimeMs gvt() const noexcept { return gvt_; }
+    size_t rollbacks() const noexcept { return sum(&Lp::rollbacks); }
+    size_t steps_rolled_back() const noexcept { return sum(&Lp::undone); }
+    size_t anti_messages() const noexcept { return sum(&Lp::antis); }
+    size_t steps() const noexcept { return sum(&Lp::steps); }
+
+    // 模拟开始前可以直接 schedule 初始事件、设置初始状态；运行中只能在本 LP 的回调里使用
+    Scheduler &lp(size_t i) noexcept { return lps[i].sched; }
+    State &state(size_t i) noexcept { return lps[i].state; }
+    const State &state(size_t i) const noexcept { return lps[i].state; }
+
+    // 从 src 向 dst 发送消息，在 dst 中于绝对时间 ts 执行 f，ts 必须晚于 src 的当前时间。运行中只能在 src 的回调里调用
+    template <typename F> void send(size_t src, size_t dst, TimeMs ts, F &&f) {
+        assert(src < lps.size() && dst < lps.size());
+        Lp &p = lps[src];
+        assert(ts > p.sched.now());
+        Input in{ts, static_cast<uint32_t>(src), p.next_id++, Callback(std::forward<F>(f))};
+        p.outputs.push_back(Output{p.sched.now(), ts, static_cast<uint32_t>(dst), in.id});
+        post(dst, Mail{std::move(in), false});
+    }
+
+    // 执行所有时间不晚于 end 的事件，之后所有 LP 的时间都是 end
+    void run_until(TimeMs end) {
+        std::barrier sync(static_cast<std::ptrdiff_t>(threads_));
+        bool stop = false;
+        TimeMs bound{};
+        auto worker = [&](size_t w) {
+            while (true) {
+                if (w == 0) {
+                    settle();
+                    stop = gvt_ > end;
+                    if (!stop) bound = gvt_ + std::min(end - gvt_, optimism_ - 1);
+                }
+                sync.arrive_and_wait();
+                if (stop) return;
+                advance(w, bound);
+                sync.arrive_and_wait();
+            }
+        };
+        std::vector<std::thread> pool;
+        pool.reserve(threads_ - 1);
+        for (size_t w = 1; w < threads_; ++w) pool.emplace_back(worker, w);
+        worker(0);
+        for (std::thread &t : pool) t.join();
+        for (Lp &p : lps) {
+            if (p.sched.now() < end) p.sched.tick(end - p.sched.now());
+            p.done_until = std::max(p.done_until, end + 1);
+        }
+    }
+
+private:
+    struct Input {
+        TimeMs ts;
+        uint32_t src;
+        uint64_t id; // 发送方内递增，不随回滚倒退
+        Callback cb;
+    };
+    struct Output {
+        TimeMs sent_at;
+        TimeMs ts;
+        uint32_t dst;
+        uint64_t id;
+    };
+    struct Mail {
+        Input in;
+        bool anti; // 反消息只使用 src 和 id
+    };
+    // 执行时刻 time 之前的状态
+    struct Checkpoint {
+        TimeMs time;
+        TimeMs done_until; // 执行之前的进度，time 之前可能有没有事件的空档
+        State state;
+        Scheduler sched;
+        size_t next_input; // 以下均为绝对下标
+        size_t outputs;
+    };
+
+    struct Lp {
+        Scheduler sched;
+        State state{};
+        // 输入队列按 (ts, src, id) 排序，[0, next_input) 已注入调度器。下标减去 *_base 才是 deque 中的位置
+        std::deque<Input> inputs;
+        size_t inputs_base = 0;
+        size_t next_input = 0;
+        std::deque<Output> outputs;
+        size_t outputs_base = 0;
+        std::deque<Checkpoint> ckpts;
+        TimeMs done_until = std::numeric_limits<TimeMs>::min(); // 早于它的时刻都已执行
+        uint64_t next_id = 0;
+        std::mutex mtx;
+        std::vector<Mail> mailbox; // 其它线程发来的消息，按到达顺序处理
+        std::vector<Mail> draining;
+        size_t steps = 0;
+        size_t rollbacks = 0;
+        size_t undone = 0;
+        size_t antis = 0;
+
+        Input &input(size_t i) noexcept { return inputs[i - inputs_base]; }
+        size_t inputs_end() const noexcept { return inputs_base + inputs.size(); }
+        size_t outputs_end() const noexcept { return outputs_base + outputs.size(); }
+    };
+
+    size_t sum(size_t Lp::*field) const noexcept {
+        size_t n = 0;
+        for (const Lp &p : lps) n += p.*field;
+        return n;
+    }
+
+    void post(size_t dst, Mail &&m) {
+        Lp &p = lps[dst];
+        std::lock_guard lk(p.mtx);
+        p.mailbox.push_back(std::move(m));
+    }
+
+    static std::optional<TimeMs> next_time(Lp &p) {
+        std::optional<TimeMs> t = p.sched.next_deadline();
+        if (p.next_input < p.inputs_end()) {
+            TimeMs ts = p.input(p.next_input).ts;
+            if (!t || ts < *t) t = ts;
+        }
+        return t;
+    }
+
+    // 执行时刻 t：先保存检查点，再注入该时刻的消息，最后 tick 到 t（tick 中 schedule 的同一时刻事件用 tick(0) 执行）
+    void step(Lp &p, TimeMs t) {
+        p.ckpts.push_back(Checkpoint{t, p.done_until, p.state, p.sched.fork(), p.next_input, p.outputs_end()});
+        for (; p.next_input < p.inputs_end() && p.input(p.next_input).ts == t; ++p.next_input)
+            p.sched.schedule(t, Callback(p.input(p.next_input).cb), TimeMode::Absolute);
+        p.sched.tick(t - p.sched.now());
+        for (auto d = p.sched.next_deadline(); d && *d == t; d = p.sched.next_deadline()) p.sched.tick(0);
+        p.done_until = t + 1;
+        ++p.steps;
+    }
+
+    // 回滚到时刻 ts 之前：恢复第一个不早于 ts 的检查点，为之后发出的消息发送反消息
+    void rollback(Lp &p, TimeMs ts) {
+        if (ts >= p.done_until) return;
+        size_t k = p.ckpts.size();
+        while (k > 0 && p.ckpts[k - 1].time >= ts) --k;
+        assert(k < p.ckpts.size()); // 早于 GVT 的消息不会出现，所需的检查点一定还在
+        Checkpoint &c = p.ckpts[k];
+        p.state = std::move(c.state);
+        p.sched = std::move(c.sched);
+        p.next_input = c.next_input;
+        p.done_until = c.done_until;
+        for (size_t i = c.outputs; i < p.outputs_end(); ++i) {
+            const Output &o = p.outputs[i - p.outputs_base];
+            post(o.dst, Mail{Input{o.ts, static_cast<uint32_t>(&p - lps.data()), o.id, Callback{}}, true});
+            ++p.antis;
+        }
+        p.outputs.erase(p.outputs.begin() + static_cast<std::ptrdiff_t>(c.outputs - p.outputs_base), p.outputs.end());
+        p.undone += p.ckpts.size() - k;
+        p.ckpts.erase(p.ckpts.begin() + static_cast<std::ptrdiff_t>(k), p.ckpts.end());
+        ++p.rollbacks;
+    }
+
+    static bool input_before(const Input &l, const Input &r) noexcept {
+        if (l.ts != r.ts) return l.ts < r.ts;
+        if (l.src != r.src) return l.src < r.src;
+        return l.id < r.id;
+    }
+
+    void receive(Lp &p, Mail &m) {
+        rollback(p, m.in.ts);
+        auto first = p.inputs.begin() + static_cast<std::ptrdiff_t>(p.next_input - p.inputs_base);
+        if (!m.anti) {
+            p.inputs.insert(std::upper_bound(first, p.inputs.end(), m.in, input_before), std::move(m.in));
+            return;
+        }
+        auto it = std::lower_bound(first, p.inputs.end(), m.in, input_before);
+        assert(it != p.inputs.end() && it->src == m.in.src && it->id == m.in.id);
+        p.inputs.erase(it);
+    }
+
+    void drain(Lp &p) {
+        {
+            std::lock_guard lk(p.mtx);
+            p.draining.swap(p.mailbox);
+        }
+        for (Mail &m : p.draining) receive(p, m);
+        p.draining.clear();
+    }
+
+    // 线程 w 轮流推进下标 w, w + threads, ... 的 LP，每次一个时刻，直到都没有不晚于 bound 的事件。轮流而不是按时间
+    // 顺序推进，各 LP 的进度互相独立
+    void advance(size_t w, TimeMs bound) {
+        for (bool busy = true; busy;) {
+            busy = false;
+            for (size_t i = w; i < lps.size(); i += threads_) {
+                Lp &p = lps[i];
+                drain(p);
+                auto t = next_time(p);
+                if (!t || *t > bound) continue;
+                step(p, *t);
+                busy = true;
+            }
+        }
+    }
+
+    // 只在屏障处由 0 号线程调用：处理完所有在途消息（可能引发新的回滚和反消息），计算 GVT 并回收早于 GVT 的数据
+    void settle() {
+        for (bool pending = true; pending;) {
+            pending = false;
+            for (Lp &p : lps) {
+                if (p.mailbox.empty()) continue;
+                drain(p);
+                pending = true;
+            }
+        }
+        std::optional<TimeMs> g;
+        for (Lp &p : lps) {
+            auto t = next_time(p);
+            if (t && (!g || *t < *g)) g = t;
+        }
+        gvt_ = g ? *g : std::numeric_limits<TimeMs>::max();
+        for (Lp &p : lps) {
+            while (!p.ckpts.empty() && p.ckpts.front().time < gvt_) p.ckpts.pop_front();
+            for (; p.inputs_base < p.next_input && p.inputs.front().ts < gvt_; ++p.inputs_base) p.inputs.pop_front();
+            for (; !p.outputs.empty() && p.outputs.front().sent_at < gvt_; ++p.outputs_base) p.outputs.pop_front();
+        }
+    }
+
+    std::vector<Lp> lps;
+    TimeMs optimism_;
+    size_t threads_ = 1;
+    TimeMs gvt_ = std::numeric_limits<TimeMs>::min();
+};
+
+} // namespace es
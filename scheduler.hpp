@@ -1,64 +1,861 @@
 // scheduler.hpp
 #pragma once
+#include "cron.hpp"
 #include "event.hpp"
 #include "event_id.hpp"
+#include "storage.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
 #include <deque>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <optional>
-#include <queue>
 #include <sstream>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace es {
 
-enum class EventStatus : uint8_t { Alive, Cancelled };
-enum class OpType : uint8_t { Schedule, Clear, Delay };
+enum class EventStatus : uint8_t { Alive, Cancelled, Paused };
 
-template <typename Callback = DefaultCallback> class EventScheduler {
+// 自动压缩策略：槽位数超过 min_slots 且超过活跃事件数的 slots_per_alive 倍时，tick 结束后压缩。压缩后槽位数等于活跃
+// 事件数，需要再次出现同样比例的峰值才会触发，不会来回抖动
+struct CompactPolicy {
+    size_t min_slots = 4096;
+    size_t slots_per_alive = 4;
+};
+enum class OpType : uint8_t { Schedule, Clear, Delay, Resume };
+
+// 增量垃圾回收策略：pq 中旧节点和 cancel 节点（垃圾）的数量不少于 min_garbage，且占比超过 max_garbage_ratio 时，在之后
+// 的每次 tick / run 结束时以及 tick 之外的每次 cancel 后最多检查 budget 个节点，直到扫完一轮。budget 为 0 时退回到
+// cancel 中同步重建
+struct GcPolicy {
+    double max_garbage_ratio = 0.5;
+    size_t min_garbage = 64;
+    size_t budget = 256;
+};
+
+// 负载平滑：window > 0 时，schedule_after 调度的 Repeat 事件的首次触发在 [t, t + min(window, interval)) 内选择负载最低的
+// 1ms（相同时取最早的）。负载 = 一个周期之前同一相位实际触发的 Repeat 事件数 + 已经安排在该时刻首次触发的事件数。
+// 直方图只保留最近 horizon ms，horizon 必须是 2 的幂，不小于 interval 时才能看到一个周期之前的负载
+struct SmoothingPolicy {
+    TimeMs window = 0;
+    TimeMs horizon = 1024;
+};
+
+struct GcStats {
+    size_t nodes = 0;     // pq 中的节点数
+    size_t stale = 0;     // 其中的旧节点
+    size_t cancelled = 0; // 其中属于已取消事件的节点
+    size_t sweeps = 0;    // 开始过的增量清理轮数
+    size_t collected = 0; // 清理掉的节点数（包括同步重建）
+    size_t garbage() const noexcept { return stale + cancelled; }
+    double garbage_ratio() const noexcept {
+        return nodes == 0 ? 0.0 : static_cast<double>(garbage()) / static_cast<double>(nodes);
+    }
+};
+
+// tick 的唤醒统计：没有 slack 时每个不同的触发时刻都需要一次唤醒
+struct WakeupStats {
+    size_t wakeups = 0;   // 触发了事件的 tick 次数
+    size_t deadlines = 0; // 触发的事件中不同 next_fire 的个数
+    size_t saved() const noexcept { return deadlines - wakeups; }
+};
+
+// Storage 决定内部容器的类型，见 storage.hpp。DynamicStorage<Alloc> 会把 Alloc rebind 到所有内部容器，Callback 支持
+// uses-allocator 构造时，回调的存储也使用 Alloc；InlineStorage<N> 的所有容器都在对象内部，容量用完时 schedule 返回
+// EventID::invalid()
+template <typename Callback, SchedulerTraits Traits, typename Storage> class BasicEventScheduler {
+    static_assert(Traits.priority_bits >= 1 && Traits.priority_bits <= 32, "priority_bits 必须在 [1, 32] 之内");
+    static_assert(!(Traits.snapshots && Storage::fixed), "快照的 undo log 需要动态分配");
+    static_assert(!(Traits.snapshots && Storage::cow), "写时复制的存储直接用 fork() 保存状态");
+
+    using Desc = EventDesc<Callback, Traits>;
+    using Alloc = typename Storage::allocator_type;
+    template <typename T> using Vec = typename Storage::template Vec<T>;
+    template <typename T> using Vec2 = typename Storage::template Vec<T, 2>; // 固定容量时为事件容量的两倍
+
+    // 固定容量的容器是否已满，动态容器永远不满
+    template <typename C> static bool is_full(const C &c) noexcept {
+        if constexpr (Storage::fixed) return c.full();
+        else return false;
+    }
+
+    template <typename... Args> static Callback make_callback(const Alloc &a, Args &&...args) {
+        if constexpr (std::uses_allocator_v<Callback, Alloc>)
+            return std::make_obj_using_allocator<Callback>(a, std::forward<Args>(args)...);
+        else return Callback(std::forward<Args>(args)...);
+    }
 
-    using Desc = EventDesc<Callback>;
+    static constexpr uint32_t npos = EventID::u32max;
+    static constexpr uint64_t pri_limit = uint64_t{1} << Traits.priority_bits;
+    // 排序键 = 优先级 | 同优先级内的次序。次序默认是槽位 index；deterministic 时是调度序号，占满优先级以下的全部位
+    static constexpr unsigned key_low_bits = Traits.deterministic ? 64 - Traits.priority_bits : 32;
 
     struct Event {
+        Event() = default;
+        explicit Event(const Alloc &a) : desc{.callback = make_callback(a)} {}
+
         Desc desc{};
         EventStatus status = EventStatus::Cancelled;
+        bool queued = false; // 当前 stamp 的节点是否在 pq 中
         TimeMs next_fire = TimeMs{};
+        // 仅限 Paused 使用，恢复时距离触发的剩余时间
+        ES_NO_UNIQUE_ADDRESS Field<Traits.pause, TimeMs{}> paused_left{};
+        // 组内侵入式双向链表
+        uint32_t group = npos;
+        uint32_t group_prev = npos;
+        uint32_t group_next = npos;
+        uint32_t stamp = 0; // 每次入堆加一，pq 中 stamp 不同的节点为旧节点
+        ES_NO_UNIQUE_ADDRESS Field<Traits.deterministic, uint64_t{}> seq{}; // 进入调度器时的序号
+    };
+
+    struct Group {
+        uint32_t head = npos;
+        uint32_t size = 0;
+        uint32_t gen = 0;
+        bool paused = false;
+        bool used = false;
+    };
+
+    using Events = typename Storage::template Slots<Event>;
+
+    // pq 节点保存排序键的快照，比较时不需要访问 events
+    struct Node {
+        TimeMs next_fire;
+        uint64_t key; // 高位为优先级，低 key_low_bits 位为槽位 index 或调度序号
+        uint32_t index;
+        uint32_t stamp;
+    };
+
+    // 小根堆
+    class HeapPQ {
+    public:
+        HeapPQ() = default;
+        explicit HeapPQ(const Alloc &a) : heap(a) {}
+
+        static bool before(const Node &lhs, const Node &rhs) noexcept {
+            if (lhs.next_fire != rhs.next_fire) return lhs.next_fire < rhs.next_fire;
+            return lhs.key < rhs.key;
+        }
+
+        bool empty() const noexcept { return heap.empty(); }
+        bool full() const noexcept { return is_full(heap); }
+        size_t size() const noexcept { return heap.size(); }
+        size_t heap_size() const noexcept { return heap.size(); }
+        const Node &top() const noexcept { return heap.front(); }
+        void clear() noexcept { heap.clear(); }
+
+        void push(const Node &n) {
+            heap.push_back(n);
+            sift_up(heap.size() - 1);
+        }
+
+        void pop() noexcept {
+            heap.front() = heap.back();
+            heap.pop_back();
+            if (!heap.empty()) sift_down(0);
+        }
+
+        // 删除满足 pred 的节点后原地建堆，O(n)
+        template <typename Pred> void erase_if(Pred &&pred) {
+            size_t w = 0;
+            for (size_t r = 0; r < heap.size(); ++r)
+                if (!pred(heap[r])) heap[w++] = heap[r];
+            heap.resize(w);
+            for (size_t i = heap.size() / 2; i-- > 0;) sift_down(i);
+        }
+
+        // 从 cursor 往前检查最多 budget 个节点，删除满足 pred 的节点，返回新的 cursor，返回 0 表示一轮结束。两次调用
+        // 之间堆可能已经变化，所以一轮不保证检查到所有节点
+        template <typename Pred> size_t sweep(Pred &&pred, size_t cursor, size_t budget) {
+            cursor = std::min(cursor, heap.size());
+            for (; cursor > 0 && budget > 0; --budget) {
+                --cursor;
+                if (pred(heap[cursor])) remove_at(cursor);
+            }
+            return cursor;
+        }
+
+        // 按出堆顺序遍历节点，f 返回 false 时停止。frontier 是调用方提供的工作区，大小不会超过堆的大小
+        template <typename F, typename Scratch> void walk(F &&f, Scratch &frontier) const {
+            if (heap.empty()) return;
+            auto by_node = [&](size_t l, size_t r) { return before(heap[r], heap[l]); };
+            auto push_i = [&](size_t i) {
+                frontier.push_back(i);
+                std::push_heap(frontier.begin(), frontier.end(), by_node);
+            };
+            frontier.clear();
+            push_i(0);
+            while (!frontier.empty()) {
+                std::pop_heap(frontier.begin(), frontier.end(), by_node);
+                size_t i = frontier.back();
+                frontier.pop_back();
+                if (!f(heap[i])) return;
+                if (2 * i + 1 < heap.size()) push_i(2 * i + 1);
+                if (2 * i + 2 < heap.size()) push_i(2 * i + 2);
+            }
+        }
+
+    private:
+        void remove_at(size_t i) noexcept {
+            heap[i] = heap.back();
+            heap.pop_back();
+            if (i == heap.size()) return;
+            if (i > 0 && before(heap[i], heap[(i - 1) / 2])) sift_up(i);
+            else sift_down(i);
+        }
+
+        void sift_up(size_t i) noexcept {
+            Node n = heap[i];
+            while (i > 0) {
+                size_t p = (i - 1) / 2;
+                if (!before(n, heap[p])) break;
+                heap[i] = heap[p];
+                i = p;
+            }
+            heap[i] = n;
+        }
+
+        void sift_down(size_t i) noexcept {
+            Node n = heap[i];
+            size_t sz = heap.size();
+            while (true) {
+                size_t c = 2 * i + 1;
+                if (c >= sz) break;
+                if (c + 1 < sz && before(heap[c + 1], heap[c])) ++c;
+                if (!before(heap[c], n)) break;
+                heap[i] = heap[c];
+                i = c;
+            }
+            heap[i] = n;
+        }
+
+        Vec2<Node> heap;
+    };
+
+    // 同一 (next_fire, 优先级) 的节点共用一个堆节点（桶），桶内是侵入式链表。同一时刻的 N 个事件只需要一次堆操作。
+    // 节点入桶时追加到尾部，桶到达堆顶时才按 key 归并排序一次，所以出堆顺序与 HeapPQ 相同
+    class BucketPQ {
+        struct Entry {
+            Node node;
+            uint32_t next = npos;
+        };
+        struct Bucket {
+            TimeMs next_fire{};
+            uint64_t cls = 0; // key 的优先级部分
+            uint32_t head = npos;
+            uint32_t tail = npos; // 空闲时为 free list 的下一个
+            bool sorted = true;
+        };
+
+    public:
+        BucketPQ() = default;
+        explicit BucketPQ(const Alloc &a) : entries(a), buckets(a), heap(a), table(a) {
+            if constexpr (Storage::fixed) table.assign(table.capacity(), npos);
+        }
+
+        bool empty() const noexcept { return n == 0; }
+        bool full() const noexcept { return entry_fl == npos && is_full(entries); }
+        size_t size() const noexcept { return n; }
+        size_t heap_size() const noexcept { return heap.size(); }
+        const Node &top() const noexcept { return entries[buckets[heap.front()].head].node; }
+
+        void clear() noexcept {
+            entries.clear();
+            buckets.clear();
+            heap.clear();
+            std::fill(table.begin(), table.end(), npos);
+            entry_fl = npos;
+            bucket_fl = npos;
+            n = 0;
+        }
+
+        void push(const Node &nd) {
+            uint64_t cls = nd.key >> key_low_bits;
+            uint32_t b = find(nd.next_fire, cls);
+            if (b == npos) b = add_bucket(nd.next_fire, cls);
+            uint32_t e = new_entry(nd);
+            // 堆顶的桶总是有序的，其余的桶直接追加
+            if (b == heap.front()) insert_sorted(buckets[b], e);
+            else append(buckets[b], e);
+            ++n;
+        }
+
+        void pop() noexcept {
+            uint32_t b = heap.front();
+            Bucket &bk = buckets[b];
+            uint32_t e = bk.head;
+            bk.head = entries[e].next;
+            if (bk.head == npos) bk.tail = npos;
+            free_entry(e);
+            --n;
+            if (bk.head != npos) return;
+            // 桶空了，整个桶出堆
+            erase_from_table(b);
+            heap.front() = heap.back();
+            heap.pop_back();
+            if (!heap.empty()) sift_down(0);
+            free_bucket(b);
+            sort_top();
+        }
+
+        // 删除满足 pred 的节点，丢掉空桶后原地建堆，O(n)
+        template <typename Pred> void erase_if(Pred &&pred) {
+            size_t w = 0;
+            for (size_t r = 0; r < heap.size(); ++r) {
+                uint32_t b = heap[r];
+                filter(buckets[b], pred);
+                if (buckets[b].head == npos) free_bucket(b);
+                else heap[w++] = b;
+            }
+            heap.resize(w);
+            for (size_t i = heap.size() / 2; i-- > 0;) sift_down(i);
+            rehash(table.size());
+            sort_top();
+        }
+
+        // 同 HeapPQ::sweep，但以桶为单位检查，一个桶内的节点总是一次检查完
+        template <typename Pred> size_t sweep(Pred &&pred, size_t cursor, size_t budget) {
+            cursor = std::min(cursor, heap.size());
+            while (cursor > 0 && budget > 0) {
+                --cursor;
+                uint32_t b = heap[cursor];
+                budget -= std::min(budget, filter(buckets[b], pred));
+                if (buckets[b].head != npos) continue;
+                erase_from_table(b);
+                remove_at(cursor);
+                free_bucket(b);
+            }
+            sort_top();
+            return cursor;
+        }
+
+        // 按出堆顺序遍历。未排序的桶先把节点下标追加到 frontier 尾部按 key 排序，frontier 的大小不超过节点数
+        template <typename F, typename Scratch> void walk(F &&f, Scratch &frontier) const {
+            if (heap.empty()) return;
+            auto by_bucket = [&](size_t l, size_t r) { return before(heap[r], heap[l]); };
+            auto push_i = [&](size_t i) {
+                frontier.push_back(i);
+                std::push_heap(frontier.begin(), frontier.end(), by_bucket);
+            };
+            frontier.clear();
+            push_i(0);
+            while (!frontier.empty()) {
+                std::pop_heap(frontier.begin(), frontier.end(), by_bucket);
+                size_t i = frontier.back();
+                frontier.pop_back();
+                const Bucket &bk = buckets[heap[i]];
+                if (bk.sorted) {
+                    for (uint32_t e = bk.head; e != npos; e = entries[e].next)
+                        if (!f(entries[e].node)) return;
+                } else {
+                    size_t mark = frontier.size();
+                    for (uint32_t e = bk.head; e != npos; e = entries[e].next) frontier.push_back(e);
+                    std::sort(frontier.begin() + static_cast<std::ptrdiff_t>(mark), frontier.end(),
+                              [&](size_t l, size_t r) { return entries[l].node.key < entries[r].node.key; });
+                    for (size_t k = mark; k < frontier.size(); ++k)
+                        if (!f(entries[frontier[k]].node)) return;
+                    frontier.resize(mark);
+                }
+                if (2 * i + 1 < heap.size()) push_i(2 * i + 1);
+                if (2 * i + 2 < heap.size()) push_i(2 * i + 2);
+            }
+        }
+
+    private:
+        bool before(uint32_t lhs, uint32_t rhs) const noexcept {
+            const Bucket &l = buckets[lhs];
+            const Bucket &r = buckets[rhs];
+            if (l.next_fire != r.next_fire) return l.next_fire < r.next_fire;
+            return l.cls < r.cls;
+        }
+
+        uint32_t new_entry(const Node &nd) {
+            uint32_t e;
+            if (entry_fl != npos) {
+                e = entry_fl;
+                entry_fl = entries[e].next;
+            } else {
+                e = static_cast<uint32_t>(entries.size());
+                entries.emplace_back();
+            }
+            entries[e] = Entry{nd, npos};
+            return e;
+        }
+
+        void free_entry(uint32_t e) noexcept {
+            entries[e].next = entry_fl;
+            entry_fl = e;
+        }
+
+        void free_bucket(uint32_t b) noexcept {
+            buckets[b].head = npos;
+            buckets[b].tail = bucket_fl;
+            bucket_fl = b;
+        }
+
+        uint32_t add_bucket(TimeMs next_fire, uint64_t cls) {
+            uint32_t b;
+            if (bucket_fl != npos) {
+                b = bucket_fl;
+                bucket_fl = buckets[b].tail;
+            } else {
+                b = static_cast<uint32_t>(buckets.size());
+                buckets.emplace_back();
+            }
+            buckets[b] = Bucket{next_fire, cls, npos, npos, true};
+            // 装载率不超过 1/2；固定容量时表的大小是节点容量的两倍，不需要扩容
+            if constexpr (!Storage::fixed)
+                if ((heap.size() + 1) * 2 > table.size()) rehash(std::max<size_t>(16, table.size() * 2));
+            insert_to_table(b);
+            heap.push_back(b);
+            sift_up(heap.size() - 1);
+            return b;
+        }
+
+        // 删除桶内满足 pred 的节点，保持原来的顺序，返回检查的节点数
+        template <typename Pred> size_t filter(Bucket &bk, Pred &pred) {
+            size_t examined = 0;
+            uint32_t e = bk.head;
+            bk.head = bk.tail = npos;
+            while (e != npos) {
+                uint32_t next = entries[e].next;
+                ++examined;
+                if (pred(entries[e].node)) {
+                    free_entry(e);
+                    --n;
+                } else {
+                    entries[e].next = npos;
+                    if (bk.tail == npos) bk.head = e;
+                    else entries[bk.tail].next = e;
+                    bk.tail = e;
+                }
+                e = next;
+            }
+            return examined;
+        }
+
+        void remove_at(size_t i) noexcept {
+            heap[i] = heap.back();
+            heap.pop_back();
+            if (i == heap.size()) return;
+            if (i > 0 && before(heap[i], heap[(i - 1) / 2])) sift_up(i);
+            else sift_down(i);
+        }
+
+        void append(Bucket &bk, uint32_t e) noexcept {
+            if (bk.head == npos) {
+                bk.head = bk.tail = e;
+                return;
+            }
+            if (entries[e].node.key < entries[bk.tail].node.key) bk.sorted = false;
+            entries[bk.tail].next = e;
+            bk.tail = e;
+        }
+
+        void sort_top() noexcept {
+            if (heap.empty()) return;
+            Bucket &bk = buckets[heap.front()];
+            if (bk.sorted) return;
+            bk.head = sort_list(bk.head);
+            for (bk.tail = bk.head; entries[bk.tail].next != npos;) bk.tail = entries[bk.tail].next;
+            bk.sorted = true;
+        }
+
+        // 稳定的链表归并排序
+        uint32_t sort_list(uint32_t h) noexcept {
+            if (h == npos || entries[h].next == npos) return h;
+            uint32_t slow = h, fast = entries[h].next;
+            while (fast != npos && entries[fast].next != npos) {
+                slow = entries[slow].next;
+                fast = entries[entries[fast].next].next;
+            }
+            uint32_t r = entries[slow].next;
+            entries[slow].next = npos;
+            uint32_t a = sort_list(h), b = sort_list(r);
+            uint32_t head = npos, tail = npos;
+            while (a != npos || b != npos) {
+                uint32_t take;
+                if (b == npos || (a != npos && entries[a].node.key <= entries[b].node.key)) {
+                    take = a;
+                    a = entries[a].next;
+                } else {
+                    take = b;
+                    b = entries[b].next;
+                }
+                if (tail == npos) head = take;
+                else entries[tail].next = take;
+                tail = take;
+            }
+            entries[tail].next = npos;
+            return head;
+        }
+
+        void insert_sorted(Bucket &bk, uint32_t e) noexcept {
+            uint64_t key = entries[e].node.key;
+            if (bk.head == npos) {
+                bk.head = bk.tail = e;
+            } else if (entries[bk.tail].node.key <= key) {
+                entries[bk.tail].next = e;
+                bk.tail = e;
+            } else if (key < entries[bk.head].node.key) {
+                entries[e].next = bk.head;
+                bk.head = e;
+            } else {
+                uint32_t p = bk.head;
+                while (entries[entries[p].next].node.key <= key) p = entries[p].next;
+                entries[e].next = entries[p].next;
+                entries[p].next = e;
+            }
+        }
+
+        // (next_fire, cls) -> 桶，线性探测的开放寻址表
+        size_t home(TimeMs next_fire, uint64_t cls) const noexcept {
+            uint64_t h = (static_cast<uint64_t>(next_fire) ^ (cls * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+            return static_cast<size_t>(h ^ (h >> 31)) % table.size();
+        }
+
+        uint32_t find(TimeMs next_fire, uint64_t cls) const noexcept {
+            if (table.empty()) return npos;
+            for (size_t i = home(next_fire, cls);; i = (i + 1) % table.size()) {
+                uint32_t b = table[i];
+                if (b == npos) return npos;
+                if (buckets[b].next_fire == next_fire && buckets[b].cls == cls) return b;
+            }
+        }
+
+        void insert_to_table(uint32_t b) noexcept {
+            size_t i = home(buckets[b].next_fire, buckets[b].cls);
+            while (table[i] != npos) i = (i + 1) % table.size();
+            table[i] = b;
+        }
+
+        // 删除后把后面的元素往前移，不需要墓碑
+        void erase_from_table(uint32_t b) noexcept {
+            size_t i = home(buckets[b].next_fire, buckets[b].cls);
+            while (table[i] != b) i = (i + 1) % table.size();
+            size_t j = i;
+            while (true) {
+                j = (j + 1) % table.size();
+                uint32_t c = table[j];
+                if (c == npos) break;
+                size_t k = home(buckets[c].next_fire, buckets[c].cls);
+                bool stay = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+                if (stay) continue;
+                table[i] = c;
+                i = j;
+            }
+            table[i] = npos;
+        }
+
+        void rehash(size_t sz) {
+            table.assign(sz, npos);
+            for (uint32_t b : heap) insert_to_table(b);
+        }
+
+        void sift_up(size_t i) noexcept {
+            uint32_t b = heap[i];
+            while (i > 0) {
+                size_t p = (i - 1) / 2;
+                if (!before(b, heap[p])) break;
+                heap[i] = heap[p];
+                i = p;
+            }
+            heap[i] = b;
+        }
+
+        void sift_down(size_t i) noexcept {
+            uint32_t b = heap[i];
+            size_t sz = heap.size();
+            while (true) {
+                size_t c = 2 * i + 1;
+                if (c >= sz) break;
+                if (c + 1 < sz && before(heap[c + 1], heap[c])) ++c;
+                if (!before(heap[c], b)) break;
+                heap[i] = heap[c];
+                i = c;
+            }
+            heap[i] = b;
+        }
+
+        Vec2<Entry> entries;
+        Vec2<Bucket> buckets;
+        Vec2<uint32_t> heap;
+        typename Storage::template Vec<uint32_t, 4> table;
+        uint32_t entry_fl = npos;
+        uint32_t bucket_fl = npos;
+        size_t n = 0;
     };
 
-    using Events = std::deque<Event>; // 防止扩容 Callback 搬家
-
-    struct EventCompare {
-        const Events &events;
-        explicit EventCompare(const Events &es) : events(es) {}
-        bool tie_break(const EventID &lhs, const EventID &rhs) const noexcept {
-            const Event &le = events[lhs.index];
-            const Event &re = events[rhs.index];
-            if (le.desc.pri == re.desc.pri) return lhs.index > rhs.index;
-            return le.desc.pri > re.desc.pri;
-        }
-        bool operator()(const EventID &lhs, const EventID &rhs) const noexcept {
-            // 小根堆
-            const Event &le = events[lhs.index];
-            const Event &re = events[rhs.index];
-            if (le.next_fire == re.next_fire) return tie_break(lhs, rhs);
-            return le.next_fire > re.next_fire;
-        }
-        friend void swap(EventCompare &, EventCompare &) noexcept {}
+    // 两层队列：next_fire < boundary 的节点在热队列 Hot 中，其余的节点追加到无序的 overflow 中。热队列为空时扫描一遍
+    // overflow，把 [最早的 next_fire, 最早的 next_fire + tier_horizon) 内的节点搬进热队列，不排序，开销与 overflow
+    // 的大小成线性。热队列中的节点总是早于 overflow 中的节点，所以热队列的堆顶就是全局的堆顶，而热队列的大小只与
+    // tier_horizon 内的事件数有关
+    template <typename Hot> class TieredPQ {
+    public:
+        TieredPQ() = default;
+        explicit TieredPQ(const Alloc &a) : hot(a), overflow(a) {}
+
+        bool empty() const noexcept { return hot.empty(); } // 热队列为空时 overflow 也为空
+        bool full() const noexcept { return hot.full() || is_full(overflow); }
+        size_t size() const noexcept { return hot.size() + overflow.size(); }
+        size_t heap_size() const noexcept { return hot.heap_size(); }
+        size_t overflow_size() const noexcept { return overflow.size(); }
+        const Node &top() const noexcept { return hot.top(); }
+
+        void clear() noexcept {
+            hot.clear();
+            overflow.clear();
+            sorted = true;
+            boundary = std::numeric_limits<TimeMs>::min();
+            overflow_min = std::numeric_limits<TimeMs>::max();
+        }
+
+        void push(const Node &n) {
+            if (n.next_fire < boundary) {
+                hot.push(n);
+            } else if (hot.empty()) {
+                assert(overflow.empty());
+                boundary = n.next_fire + Traits.tier_horizon;
+                hot.push(n);
+            } else {
+                if (!overflow.empty() && before(overflow.back(), n)) sorted = false;
+                overflow.push_back(n);
+                overflow_min = std::min(overflow_min, n.next_fire);
+            }
+        }
+
+        void pop() {
+            hot.pop();
+            migrate();
+        }
+
+        template <typename Pred> void erase_if(Pred &&pred) {
+            hot.erase_if(pred);
+            size_t w = 0;
+            for (size_t r = 0; r < overflow.size(); ++r)
+                if (!pred(overflow[r])) overflow[w++] = overflow[r];
+            overflow.resize(w);
+            migrate();
+        }
+
+        // overflow 排在热队列之后，先从 overflow 的末尾开始检查
+        template <typename Pred> size_t sweep(Pred &&pred, size_t cursor, size_t budget) {
+            cursor = std::min(cursor, size());
+            for (; cursor > hot.size() && budget > 0; --budget) {
+                --cursor;
+                size_t i = cursor - hot.size();
+                if (!pred(overflow[i])) continue;
+                overflow[i] = overflow.back();
+                overflow.pop_back();
+                sorted = false;
+            }
+            if (budget > 0) cursor = hot.sweep(pred, cursor, budget);
+            migrate();
+            return cursor;
+        }
+
+        // 先遍历热队列，再按顺序遍历 overflow，需要时先排序。只有遍历需要 overflow 有序
+        template <typename F, typename Scratch> void walk(F &&f, Scratch &frontier) const {
+            bool stopped = false;
+            hot.walk(
+                [&](const Node &n) {
+                    stopped = !f(n);
+                    return !stopped;
+                },
+                frontier);
+            if (stopped) return;
+            sort_overflow();
+            for (size_t i = overflow.size(); i-- > 0;)
+                if (!f(overflow[i])) return;
+        }
+
+    private:
+        static bool before(const Node &lhs, const Node &rhs) noexcept { return HeapPQ::before(lhs, rhs); }
+
+        // overflow 按降序排列，最早的节点在末尾
+        void sort_overflow() const {
+            if (sorted) return;
+            std::sort(overflow.begin(), overflow.end(), [](const Node &l, const Node &r) { return before(r, l); });
+            sorted = true;
+        }
+
+        // overflow_min 是下界：sweep / erase_if 删除节点后不更新。按它划分没有搬出节点时说明已经过期，划分的同时算出了
+        // 准确的最小值，再划分一次
+        void migrate() {
+            if (!hot.empty() || overflow.empty()) return;
+            if (!split(overflow_min + Traits.tier_horizon)) split(overflow_min + Traits.tier_horizon);
+        }
+
+        // 把早于 b 的节点搬进热队列，保持其余节点的相对顺序并重新计算它们的最小 next_fire。返回是否搬出了节点
+        bool split(TimeMs b) {
+            boundary = b;
+            overflow_min = std::numeric_limits<TimeMs>::max();
+            size_t w = 0;
+            for (size_t r = 0; r < overflow.size(); ++r) {
+                const Node &n = overflow[r];
+                if (n.next_fire < b) {
+                    hot.push(n);
+                } else {
+                    overflow_min = std::min(overflow_min, n.next_fire);
+                    overflow[w++] = n;
+                }
+            }
+            bool moved = w < overflow.size();
+            overflow.resize(w);
+            return moved;
+        }
+
+        Hot hot;
+        mutable Vec2<Node> overflow; // 排序不改变内容，walk 中可以按需排序
+        mutable bool sorted = true;  // overflow 是否按降序排列，只用于 walk
+        TimeMs boundary = std::numeric_limits<TimeMs>::min();
+        TimeMs overflow_min = std::numeric_limits<TimeMs>::max(); // overflow 中最早的 next_fire 的下界
     };
 
+    // run() 的批量模式：开始时把 pq 中的所有节点取出并一次性排序成 sorted，之后按顺序消费，运行中新加入的节点进入
+    // 内层队列（通常很小），每次取两者中较早的一个，所以出堆顺序与内层队列单独使用时相同
+    template <typename Inner> class SortedRunPQ {
+    public:
+        SortedRunPQ() = default;
+        explicit SortedRunPQ(const Alloc &a) : inner(a), sorted(a), scratch(a) {}
+
+        bool empty() const noexcept { return sorted.empty() && inner.empty(); }
+        bool full() const noexcept { return inner.full() || is_full(sorted); }
+        size_t size() const noexcept { return inner.size() + sorted.size(); }
+        size_t heap_size() const noexcept { return inner.heap_size(); }
+        size_t overflow_size() const noexcept
+            requires requires(const Inner &q) { q.overflow_size(); }
+        {
+            return inner.overflow_size();
+        }
+        size_t sorted_size() const noexcept { return sorted.size(); }
+        const Node &top() const noexcept { return from_sorted() ? sorted.back() : inner.top(); }
+
+        void clear() noexcept {
+            inner.clear();
+            sorted.clear();
+        }
+
+        void push(const Node &n) { inner.push(n); }
+
+        void pop() {
+            if (from_sorted()) sorted.pop_back();
+            else inner.pop();
+        }
+
+        // 把内层队列的节点全部并入 sorted 并重新排序
+        void sort_all() {
+            inner.erase_if([this](const Node &n) {
+                sorted.push_back(n);
+                return true;
+            });
+            sort_desc();
+        }
+
+        template <typename Pred> void erase_if(Pred &&pred) {
+            inner.erase_if(pred);
+            size_t w = 0;
+            for (size_t r = 0; r < sorted.size(); ++r)
+                if (!pred(sorted[r])) sorted[w++] = sorted[r];
+            sorted.resize(w);
+        }
+
+        // sorted 排在内层队列之后。删除时需要保持顺序，只在 run() 被异常打断、sorted 有残留时才会走到这里
+        template <typename Pred> size_t sweep(Pred &&pred, size_t cursor, size_t budget) {
+            cursor = std::min(cursor, size());
+            for (; cursor > inner.size() && budget > 0; --budget) {
+                --cursor;
+                size_t i = cursor - inner.size();
+                if (!pred(sorted[i])) continue;
+                std::move(sorted.begin() + static_cast<std::ptrdiff_t>(i) + 1, sorted.end(),
+                          sorted.begin() + static_cast<std::ptrdiff_t>(i));
+                sorted.pop_back();
+            }
+            if (budget > 0) cursor = inner.sweep(pred, cursor, budget);
+            return cursor;
+        }
+
+        // 遍历内层队列的同时按顺序插入 sorted 中更早的节点
+        template <typename F, typename Scratch> void walk(F &&f, Scratch &frontier) const {
+            size_t r = sorted.size();
+            bool stopped = false;
+            inner.walk(
+                [&](const Node &n) {
+                    for (; !stopped && r > 0 && HeapPQ::before(sorted[r - 1], n); --r) stopped = !f(sorted[r - 1]);
+                    if (!stopped) stopped = !f(n);
+                    return !stopped;
+                },
+                frontier);
+            if (stopped) return;
+            for (; r > 0; --r)
+                if (!f(sorted[r - 1])) return;
+        }
+
+    private:
+        bool from_sorted() const noexcept {
+            if (sorted.empty()) return false;
+            return inner.empty() || HeapPQ::before(sorted.back(), inner.top());
+        }
+
+        // 按 (next_fire, key) 降序排列，最早的节点在末尾。节点多时用 LSD 基数排序，所有节点都相同的字节直接跳过，
+        // 时间跨度小、优先级少时实际只需要少数几趟
+        void sort_desc() {
+            constexpr size_t radix_min = 1024;
+            if (sorted.size() < radix_min) {
+                std::sort(sorted.begin(), sorted.end(), [](const Node &l, const Node &r) { return HeapPQ::before(r, l); });
+                return;
+            }
+            // 取反后升序即原顺序的降序；next_fire 翻转符号位后按无符号比较
+            auto digit = [](const Node &n, unsigned pass) -> uint8_t {
+                uint64_t v = pass < 8 ? n.key : static_cast<uint64_t>(n.next_fire) ^ (uint64_t{1} << 63);
+                return static_cast<uint8_t>(~v >> (8 * (pass % 8)));
+            };
+            std::array<std::array<size_t, 256>, 16> count{};
+            for (const Node &n : sorted)
+                for (unsigned p = 0; p < 16; ++p) ++count[p][digit(n, p)];
+            scratch.resize(sorted.size());
+            for (unsigned p = 0; p < 16; ++p) {
+                auto &c = count[p];
+                if (c[digit(sorted.front(), p)] == sorted.size()) continue;
+                size_t sum = 0;
+                for (size_t &x : c) sum += std::exchange(x, sum);
+                for (const Node &n : sorted) scratch[c[digit(n, p)]++] = n;
+                sorted.swap(scratch);
+            }
+            scratch.clear();
+        }
+
+        Inner inner;
+        Vec2<Node> sorted;  // 降序，最早的节点在末尾
+        Vec2<Node> scratch; // 基数排序的工作区
+    };
+
+    using HotPQ = std::conditional_t<Traits.bucketing, BucketPQ, HeapPQ>;
+    using TierPQ = std::conditional_t<(Traits.tier_horizon > 0), TieredPQ<HotPQ>, HotPQ>;
+    using PQ = std::conditional_t<Traits.batch_run, SortedRunPQ<TierPQ>, TierPQ>;
+
     struct Op {
-        OpType op_type;
+        OpType op_type = OpType::Schedule;
         // for schedule || set next fire
-        TimeMs next_fire;
+        TimeMs next_fire{};
         Desc desc;
         EventID eid;
+        uint32_t group = npos; // for schedule || resume
     };
 
     struct TickGuard {
-        EventScheduler *es;
-        explicit TickGuard(EventScheduler *_es) : es(_es) {
+        BasicEventScheduler *es;
+        explicit TickGuard(BasicEventScheduler *_es) : es(_es) {
             assert(!es->ticking);
             es->ticking = true;
             assert(es->delay_ops.empty());
@@ -71,90 +868,607 @@ template <typename Callback = DefaultCallback> class EventScheduler {
         }
     };
 
-    using PQ = std::priority_queue<EventID, std::vector<EventID>, EventCompare>;
-    using FL = std::vector<uint32_t>;
-    using Idxs = std::vector<uint32_t>;
-    using Gens = std::vector<uint32_t>;
-    using Ops = std::vector<Op>;
+    using FL = Vec<uint32_t>;
+    using Idxs = Vec<uint32_t>;
+    using Gens = Vec<uint32_t>;
+    using Ops = Vec<Op>;
+    using Groups = Vec<Group>;
+
+    // 处理函数表，只有 Callback 为 HandlerCall 时存在
+    using Thunk = void (*)(const std::byte *payload, EventID eid);
+    struct NoHandlers {
+        NoHandlers() = default;
+        explicit NoHandlers(const Alloc &) noexcept {}
+    };
+    using Handlers = std::conditional_t<is_handler_call_v<Callback>, Vec<Thunk>, NoHandlers>;
+
+    // 日历表，只有开启 calendar 特性时存在
+    struct NoCalendars {
+        NoCalendars() = default;
+        explicit NoCalendars(const Alloc &) noexcept {}
+    };
+    using Calendars = std::conditional_t<Traits.calendar, Vec<CronExpr>, NoCalendars>;
+
+    // key -> 槽位，线性探测的开放寻址表。只记录活跃（包括暂停）的事件，cancel、触发结束、clear 时删除
+    class KeyIndex {
+        struct Entry {
+            uint64_t key = no_key;
+            uint32_t slot = npos;
+        };
+
+    public:
+        KeyIndex() = default;
+        explicit KeyIndex(const Alloc &a) : table(a) {
+            if constexpr (Storage::fixed) table.assign(table.capacity(), Entry{});
+        }
+
+        size_t size() const noexcept { return n; }
+
+        uint32_t find(uint64_t key) const noexcept {
+            if (table.empty()) return npos;
+            for (size_t i = home(key);; i = (i + 1) % table.size()) {
+                const Entry &e = table[i];
+                if (e.slot == npos) return npos;
+                if (e.key == key) return e.slot;
+            }
+        }
+
+        // key 已存在时改为指向 slot
+        void assign(uint64_t key, uint32_t slot) {
+            // 装载率不超过 1/2；固定容量时表的大小是槽位容量的四倍，不需要扩容
+            if constexpr (!Storage::fixed)
+                if ((n + 1) * 2 > table.size()) rehash(std::max<size_t>(16, table.size() * 2));
+            size_t i = home(key);
+            while (table[i].slot != npos && table[i].key != key) i = (i + 1) % table.size();
+            if (table[i].slot == npos) ++n;
+            table[i] = Entry{key, slot};
+        }
+
+        // 删除后把后面的元素往前移，不需要墓碑
+        void erase(uint64_t key) noexcept {
+            if (table.empty()) return;
+            size_t i = home(key);
+            while (table[i].slot != npos && table[i].key != key) i = (i + 1) % table.size();
+            if (table[i].slot == npos) return;
+            size_t j = i;
+            while (true) {
+                j = (j + 1) % table.size();
+                if (table[j].slot == npos) break;
+                size_t k = home(table[j].key);
+                bool stay = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+                if (stay) continue;
+                table[i] = table[j];
+                i = j;
+            }
+            table[i] = Entry{};
+            --n;
+        }
+
+        void clear() noexcept {
+            std::fill(table.begin(), table.end(), Entry{});
+            n = 0;
+        }
+
+    private:
+        size_t home(uint64_t key) const noexcept {
+            uint64_t h = key * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(h ^ (h >> 32)) % table.size();
+        }
+
+        void rehash(size_t sz) {
+            auto old = std::move(table);
+            table.assign(sz, Entry{});
+            n = 0;
+            for (const Entry &e : old)
+                if (e.slot != npos) assign(e.key, e.slot);
+        }
+
+        typename Storage::template Vec<Entry, 4> table;
+        size_t n = 0;
+    };
+    struct NoKeyIndex {
+        NoKeyIndex() = default;
+        explicit NoKeyIndex(const Alloc &) noexcept {}
+    };
+
+    // 负载直方图：observed 是过去每 ms 触发的 Repeat 事件数，planned 是平滑后安排在未来每 ms 首次触发的事件数。两者都是
+    // 以绝对时间取模的环，时间经过某一时刻时清掉对应的位置
+    struct LoadHistogram {
+        LoadHistogram() = default;
+        explicit LoadHistogram(const Alloc &a) : observed(a), planned(a) {}
+
+        Vec<uint32_t> observed;
+        Vec<uint32_t> planned;
+        TimeMs synced{}; // 已经清理到的时刻
+    };
+    // 固定容量的调度器不支持负载平滑，直方图不占空间
+    struct NoLoadHistogram {
+        NoLoadHistogram() = default;
+        explicit NoLoadHistogram(const Alloc &) noexcept {}
+    };
+
+public:
+    using StateId = uint64_t;
+
+private:
+
+    // 快照：保存时的标量和容器大小，以及之后第一次修改每个槽位 / 组之前的旧值。只记录修改过的部分，恢复的开销与修改量
+    // 有关。free list 是栈，low 以下的元素没有动过，[low, size) 的旧值按出栈顺序记在 popped 中
+    struct StackUndo {
+        size_t size = 0;
+        size_t low = 0;
+        Vec<uint32_t> popped;
+    };
+    struct SlotUndo {
+        uint32_t index;
+        uint32_t gen;
+        Event event;
+    };
+    struct GroupUndo {
+        uint32_t index;
+        Group group;
+    };
+    struct Snapshot {
+        explicit Snapshot(const Alloc &a) : fl{.popped = Vec<uint32_t>(a)}, group_fl{.popped = Vec<uint32_t>(a)}, slots(a), groups(a) {}
+
+        uint32_t epoch = 0; // 槽位的 epoch 与它相同时说明已经记录过
+        TimeMs current{};
+        TimeMs paused_time{};
+        ES_NO_UNIQUE_ADDRESS Field<Traits.slack, TimeMs{}> default_slack{};
+        Jitter default_jitter{};
+        uint64_t jitter_rng = 0;
+        WakeupStats wakeup{};
+        size_t alive = 0;
+        size_t fire_count = 0;
+        size_t slot_count = 0;
+        size_t groups_size = 0;
+        uint64_t next_seq = 0;
+        uint32_t gen_floor = 0;
+        bool paused = false;
+        StackUndo fl;
+        StackUndo group_fl;
+        Vec<SlotUndo> slots;
+        Vec<GroupUndo> groups;
+    };
+    struct Journal {
+        Journal() = default;
+        explicit Journal(const Alloc &a) : snaps(a), slot_epoch(a), group_epoch(a), restored(a) {}
+
+        typename Storage::template Slots<Snapshot> snaps;
+        StateId first_id = 0; // snaps.front() 的 id
+        uint32_t epoch = 0;
+        // 逻辑上的槽位数。恢复快照后，快照之后新建的槽位留作备用，按原来的顺序重新分配，EventID 与原来的时间线一致
+        size_t slot_count = 0;
+        Vec<uint32_t> slot_epoch;
+        Vec<uint32_t> group_epoch;
+        Vec<std::pair<uint32_t, uint32_t>> restored; // 恢复时的工作区：(槽位, 恢复前的 stamp)
+    };
+    struct NoJournal {
+        NoJournal() = default;
+        explicit NoJournal(const Alloc &) noexcept {}
+    };
+
+    template <typename Fn> struct handler_traits;
+    template <typename P> struct handler_traits<void (*)(const P &)> {
+        using payload = P;
+    };
+    template <typename P> struct handler_traits<void (*)(const P &, EventID)> {
+        using payload = P;
+    };
 
 private:
-    void set_event(TimeMs next_fire, Desc &&d, EventID eid) {
+    void set_event(TimeMs next_fire, Desc &&d, EventID eid, uint32_t group) {
         // 更新调度器
-        Event &e = events[eid.index];
+        Event &e = ev(eid.index);
         e.desc = std::move(d);
         e.status = EventStatus::Alive;
         e.next_fire = next_fire;
-        pq.push(eid);
+        if constexpr (Traits.deterministic) {
+            // tick 中的 schedule 按调用顺序 flush，所以序号只取决于调用顺序
+            assert(next_seq < (uint64_t{1} << key_low_bits));
+            e.seq = next_seq++;
+        }
         ++alive;
+        bind_key(eid.index);
+        if (group != npos) link_group(eid.index, group);
+        // 加入已暂停的组时直接进入暂停状态，不进入 pq
+        if (Traits.pause && group != npos && groups[group].paused) {
+            e.status = EventStatus::Paused;
+            e.paused_left = next_fire - current;
+            return;
+        }
+        push_event(eid.index);
+    }
+
+    static uint64_t key_of(const Event &e, uint32_t idx) noexcept {
+        uint64_t tie = Traits.deterministic ? static_cast<uint64_t>(e.seq) : idx;
+        if constexpr (!Traits.priorities) return tie;
+        Priority pri = e.desc.pri;
+        assert(pri.level < pri_limit);
+        return (static_cast<uint64_t>(pri.level) << key_low_bits) | tie;
+    }
+
+    static void restore_stack(FL &st, StackUndo &u) {
+        assert(st.size() >= u.low);
+        st.resize(u.low);
+        for (size_t i = u.popped.size(); i-- > 0;) st.push_back(u.popped[i]);
+        assert(st.size() == u.size);
+    }
+
+    // 修改槽位之前调用：有快照且本轮还没有记录过时，保存旧值
+    void touch(uint32_t idx) {
+        if constexpr (Traits.snapshots) {
+            if (journal.snaps.empty()) return;
+            Snapshot &s = journal.snaps.back();
+            if (journal.slot_epoch[idx] == s.epoch) return;
+            journal.slot_epoch[idx] = s.epoch;
+            if (idx < s.slot_count) s.slots.push_back(SlotUndo{idx, gens[idx], events[idx]});
+        }
+    }
+
+    // 需要修改的槽位和组都通过这两个函数访问，只读时直接访问 events / groups
+    Event &ev(uint32_t idx) {
+        touch(idx);
+        return events[idx];
+    }
+
+    Group &grp(uint32_t g) {
+        if constexpr (Traits.snapshots) {
+            if (!journal.snaps.empty()) {
+                Snapshot &s = journal.snaps.back();
+                if (journal.group_epoch[g] != s.epoch) {
+                    journal.group_epoch[g] = s.epoch;
+                    if (g < s.groups_size) s.groups.push_back(GroupUndo{g, groups[g]});
+                }
+            }
+        }
+        return groups[g];
+    }
+
+    // free list 出栈之前调用，记录快照中的元素
+    void note_pop(const FL &st, StackUndo Snapshot::*which) {
+        if constexpr (Traits.snapshots) {
+            if (journal.snaps.empty()) return;
+            StackUndo &u = journal.snaps.back().*which;
+            if (st.size() - 1 >= u.low) return;
+            u.popped.push_back(st.back());
+            u.low = st.size() - 1;
+        }
+    }
+
+    void note_clear(const FL &st, StackUndo Snapshot::*which) {
+        if constexpr (Traits.snapshots) {
+            if (journal.snaps.empty()) return;
+            StackUndo &u = journal.snaps.back().*which;
+            for (size_t i = std::min(u.low, st.size()); i-- > 0;) u.popped.push_back(st[i]);
+            u.low = 0;
+        }
+    }
+
+    void set_slot_count(size_t n) {
+        if constexpr (Traits.snapshots) {
+            journal.slot_count = n;
+            // 只增不减：clear 之后重新分配的槽位仍然带着本轮的 epoch，不会用新值覆盖已经记录的旧值
+            if (journal.slot_epoch.size() < events.size()) journal.slot_epoch.resize(events.size());
+        }
+    }
+
+    // 事件生效时登记 key。同一个 key 已有活跃事件时（例如同一 tick 中两次 schedule_or_replace）取消旧的，后调度的生效
+    void bind_key(uint32_t idx) {
+        if constexpr (Traits.keyed) {
+            uint64_t key = events[idx].desc.key;
+            if (key == no_key) return;
+            uint32_t old = keys.find(key);
+            if (old != npos && old != idx) {
+                cancel_slot(old);
+                collect_after_cancel();
+            }
+            keys.assign(key, idx);
+        }
+    }
+
+    // 事件不再活跃时删除 key。key 可能已经登记给了后来的事件，只删除指向自己的
+    void drop_key(uint32_t idx) noexcept {
+        if constexpr (Traits.keyed) {
+            uint64_t key = events[idx].desc.key;
+            if (key != no_key && keys.find(key) == idx) keys.erase(key);
+        }
+    }
+
+    size_t load_slot(TimeMs t) const noexcept
+        requires(!Storage::fixed)
+    {
+        return static_cast<size_t>(static_cast<uint64_t>(t) & (load.observed.size() - 1));
+    }
+
+    // 把直方图推进到 current：observed 覆盖 (current - horizon, current]，planned 覆盖 [current, current + horizon)，
+    // 移出范围的位置清零后开始新的一轮统计。快照恢复后时间可能倒退，此时不清理
+    void sync_load() noexcept
+        requires(!Storage::fixed)
+    {
+        TimeMs h = smoothing.horizon;
+        for (TimeMs t = std::max(load.synced, current - h); t < current; ++t) {
+            load.observed[load_slot(t + 1)] = 0;
+            load.planned[load_slot(t)] = 0;
+        }
+        load.synced = std::max(load.synced, current);
+    }
+
+    void note_load(TimeMs fire_time) noexcept
+        requires(!Storage::fixed)
+    {
+        sync_load();
+        if (fire_time > current - smoothing.horizon && fire_time <= current) ++load.observed[load_slot(fire_time)];
+    }
+
+    // 在 [t, t + min(window, interval)) 内选择负载最低的时刻作为首次触发时间
+    TimeMs smooth_first_fire(TimeMs t, TimeMs interval) noexcept
+        requires(!Storage::fixed)
+    {
+        sync_load();
+        TimeMs h = smoothing.horizon;
+        TimeMs w = std::min({smoothing.window, interval, h});
+        TimeMs best = t;
+        uint64_t best_load = std::numeric_limits<uint64_t>::max();
+        for (TimeMs c = t; c < t + w; ++c) {
+            uint64_t l = 0;
+            if (c >= current && c < current + h) l += load.planned[load_slot(c)];
+            TimeMs past = c - interval;
+            if (past > current - h && past <= current) l += load.observed[load_slot(past)];
+            if (l < best_load) {
+                best_load = l;
+                best = c;
+            }
+        }
+        if (best >= current && best < current + h) ++load.planned[load_slot(best)];
+        return best;
+    }
+
+    // 以当前的 next_fire 和优先级入堆，旧节点因为 stamp 不同自动失效
+    void push_event(uint32_t idx) {
+        Event &e = ev(idx);
+        ++e.stamp;
+        mark_stale(e);
+        // 固定容量时先清理旧节点。每个槽位最多剩一个节点，堆容量是槽位数的两倍，清理后一定有空位
+        if (pq.full()) rebuild_pq();
+        assert(!pq.full());
+        pq.push(Node{e.next_fire, key_of(e, idx), idx, e.stamp});
+        e.queued = true;
+    }
+
+    // stamp 改变后，原来在 pq 中的节点成为旧节点
+    void mark_stale(Event &e) noexcept {
+        if (!e.queued) return;
+        e.queued = false;
+        ++stale_nodes;
+    }
+
+    // 回收槽位，pq 中残留的节点因为 stamp 不同会被跳过
+    void recycle(uint32_t idx) noexcept {
+        Event &e = ev(idx);
+        unlink_group(idx);
+        drop_key(idx);
+        e.status = EventStatus::Cancelled;
+        ++e.stamp;
+        mark_stale(e);
+        fl.push_back(idx);
+        ++gens[idx];
+    }
+
+    void link_group(uint32_t idx, uint32_t g) {
+        Event &e = ev(idx);
+        Group &gr = grp(g);
+        e.group = g;
+        e.group_prev = npos;
+        e.group_next = gr.head;
+        if (gr.head != npos) ev(gr.head).group_prev = idx;
+        gr.head = idx;
+        ++gr.size;
+    }
+
+    void unlink_group(uint32_t idx) noexcept {
+        if (events[idx].group == npos) return;
+        Event &e = ev(idx);
+        Group &gr = grp(e.group);
+        if (e.group_prev != npos) ev(e.group_prev).group_next = e.group_next;
+        else gr.head = e.group_next;
+        if (e.group_next != npos) ev(e.group_next).group_prev = e.group_prev;
+        e.group = npos;
+        e.group_prev = npos;
+        e.group_next = npos;
+        --gr.size;
+    }
+
+    // 所有组变为空组，组本身仍然有效
+    void reset_groups() noexcept {
+        for (uint32_t g = 0; g < groups.size(); ++g) {
+            Group &gr = grp(g);
+            gr.head = npos;
+            gr.size = 0;
+            gr.paused = false;
+        }
+    }
+
+    // 取消一个活跃或暂停的事件
+    void cancel_slot(uint32_t idx) noexcept {
+        Event &e = ev(idx);
+        --alive;
+        drop_key(idx);
+        // 暂停的事件可能已经不在 pq 中，只能直接回收
+        if (e.status == EventStatus::Paused && idx != firing) {
+            recycle(idx);
+            return;
+        }
+        // 不要在这里回收，如更新 fl 和 gen 等。正在触发的事件已经出堆，由 finish_fire 回收
+        unlink_group(idx);
+        e.status = EventStatus::Cancelled;
+        if (e.queued) ++cancelled;
+    }
+
+    bool is_group(GroupID g) const noexcept {
+        if (!g.is_valid() || static_cast<size_t>(g.index) >= groups.size()) return false;
+        const Group &gr = groups[g.index];
+        return gr.used && gr.gen == g.gen;
+    }
+
+    EventID id_of(uint32_t idx) const noexcept { return EventID{idx, gens[idx]}; }
+
+    // 修改已在 pq 中的事件的触发时间
+    void move_event(EventID eid, TimeMs next_fire) {
+        // 只有 ticking 且提早事件发生时间到 current 之前的操作才有必要进入 delay ops
+        if (ticking && next_fire <= current) add_delay(eid, next_fire);
+        else default_set_next_fire(eid, next_fire);
+        settle_top();
+    }
+
+    void default_resume_group(uint32_t g) {
+        if (!groups[g].used || !groups[g].paused) return;
+        Group &gr = grp(g);
+        gr.paused = false;
+        for (uint32_t idx = gr.head; idx != npos; idx = events[idx].group_next) {
+            Event &e = ev(idx);
+            if (e.status != EventStatus::Paused) continue;
+            e.status = EventStatus::Alive;
+            e.next_fire = current + e.paused_left;
+            e.paused_left = TimeMs{};
+            // Aligned / Calendar 事件顺延到下一个边界或日历时刻，保持相位
+            if (e.desc.type == EventType::Repeat && e.desc.repeat == RepeatMode::Aligned)
+                e.next_fire = align_up(e.next_fire, e.desc.interval_ms);
+            if constexpr (Traits.calendar)
+                if (e.desc.type == EventType::Repeat && e.desc.repeat == RepeatMode::Calendar)
+                    e.next_fire = calendar_of(e.desc).next_after(e.next_fire - 1);
+            push_event(idx); // 旧节点可能仍在 pq 中，入堆后自动成为旧节点
+        }
+    }
+
+    template <typename F> static void invoke(F &f, EventID eid) {
+        if constexpr (std::is_same_v<F, FnCallback>) f.fn(f.ctx, f.arg, eid); // 没有类型擦除，直接调用
+        else if constexpr (std::is_invocable_r_v<void, F &>) f();
+        else if constexpr (std::is_invocable_r_v<void, F &, EventID>) f(eid);
+    }
+
+    // HandlerCall 通过处理函数表分发，其余回调直接调用
+    template <typename F> void dispatch(F &f, EventID eid) {
+        if constexpr (is_handler_call_v<Callback>) {
+            assert(f.handler < handlers.size());
+            handlers[f.handler](f.payload, eid);
+        } else {
+            invoke(f, eid);
+        }
     }
 
     template <typename F> void call(F &&f, EventID eid) {
-        Event &e = events[eid.index];
-        ExceptionPolicy ep = e.desc.ep;
-        try {
-            if constexpr (std::is_invocable_r_v<void, F &>) f();
-            else if (std::is_invocable_r_v<void, F &, EventID>) f(eid);
-        } catch (...) {
-            if (ep == ExceptionPolicy::Cancel) cancel(eid);
-            else if (ep == ExceptionPolicy::Rethrow) throw;
+        if constexpr (!Traits.exceptions) {
+            dispatch(f, eid);
+        } else {
+            ExceptionPolicy ep = events[eid.index].desc.ep;
+            try {
+                dispatch(f, eid);
+            } catch (...) {
+                if (ep == ExceptionPolicy::Cancel) cancel(eid);
+                else if (ep == ExceptionPolicy::Rethrow) throw;
+            }
         }
     }
 
     EventID append() {
+        if constexpr (Traits.snapshots) {
+            uint32_t spare = static_cast<uint32_t>(journal.slot_count++);
+            if (spare < events.size()) { // 恢复快照后留下的备用槽位
+                gens[spare] = gen_floor;
+                return EventID{spare, gen_floor};
+            }
+            if (journal.slot_epoch.size() <= events.size()) journal.slot_epoch.push_back(0);
+        }
         uint32_t id = static_cast<uint32_t>(events.size());
-        EventID eid{id, 0};
-        events.emplace_back();
-        gens.emplace_back(0);
+        EventID eid{id, gen_floor};
+        events.emplace_back(alloc);
+        gens.emplace_back(gen_floor);
         return eid;
     }
 
     void reuse(EventID eid) noexcept {
-        Event &e = events[eid.index];
-        if (e.status == EventStatus::Alive) --alive;
-        e.status = EventStatus::Cancelled;
-        fl.push_back(eid.index);
-        ++gens[eid.index];
+        if (events[eid.index].status != EventStatus::Cancelled) --alive;
+        recycle(eid.index);
     }
 
     // pop 不增加 gen
     EventID pop_fl() noexcept {
         EventID eid{fl.back(), gens[fl.back()]};
+        note_pop(fl, &Snapshot::fl);
         fl.pop_back();
         return eid;
     }
 
+    // 需要在 try_skip_old 之后调用，保证堆顶不是旧节点
     bool try_pop_cancelled() {
-        EventID top = pq.top();
-        const Event &e = events[top.index];
-        if (e.status != EventStatus::Cancelled) return false;
+        uint32_t idx = pq.top().index;
+        if (events[idx].status != EventStatus::Cancelled) return false;
         pq.pop();
-        fl.push_back(top.index);
-        ++gens[top.index];
+        ev(idx).queued = false;
+        recycle(idx);
         --cancelled;
         return true;
     }
 
-    // 尝试重用 cancel 节点
-    bool try_reuse(EventID eid) {
-        const Event &e = events[eid.index];
-        if (e.status != EventStatus::Cancelled) return false;
-        fl.push_back(eid.index);
-        ++gens[eid.index];
+    // 尝试丢弃旧节点，或者回收 cancel 节点。返回 true 时节点会被删除
+    bool try_reuse(const Node &n) {
+        const Event &e = events[n.index];
+        if (n.stamp != e.stamp) {
+            --stale_nodes;
+            ++gc_stats_.collected;
+            return true;
+        }
+        if (e.status != EventStatus::Cancelled || !can_collect_cancelled()) return false;
+        ev(n.index).queued = false;
+        --cancelled;
+        ++gc_stats_.collected;
+        recycle(n.index);
+        return true;
+    }
+
+    // 暂停组中的事件直接出堆，恢复时重新入堆
+    bool try_pop_paused() {
+        if constexpr (!Traits.pause) return false;
+        uint32_t idx = pq.top().index;
+        if (events[idx].status != EventStatus::Paused) return false;
+        pq.pop();
+        ev(idx).queued = false;
         return true;
     }
 
+    // 弹出堆顶的旧节点、cancel 节点和暂停节点，保证堆顶总是一个会触发的事件。每个节点只会被弹出一次，均摊 O(log n)
+    void settle_top() {
+        while (!pq.empty()) {
+            if (try_skip_old()) continue;
+            if (try_pop_cancelled()) continue;
+            if (try_pop_paused()) continue;
+            break;
+        }
+    }
+
     bool try_update_pause(TimeMs delta_ms) {
+        if constexpr (!Traits.pause) return false;
         if (!paused) return false;
         paused_time_ += delta_ms;
         return true;
     }
 
-    void add_schedule(TimeMs next_fire, Desc &&d, EventID eid) {
+    void add_schedule(TimeMs next_fire, Desc &&d, EventID eid, uint32_t group) {
+        // 直接移动构造 desc，回调保留原来的分配器
+        Op op{.op_type = OpType::Schedule, .next_fire = next_fire, .desc = std::move(d), .eid = eid, .group = group};
+        delay_ops.emplace_back(std::move(op));
+    }
+
+    void add_resume(uint32_t group) {
+        // 固定容量且 delay_ops 已满时退化为立即恢复
+        if (is_full(delay_ops)) {
+            default_resume_group(group);
+            return;
+        }
         Op op;
-        op.op_type = OpType::Schedule;
-        op.next_fire = next_fire;
-        op.desc = std::move(d);
-        op.eid = eid;
+        op.op_type = OpType::Resume;
+        op.group = group;
         delay_ops.emplace_back(std::move(op));
     }
 
@@ -167,6 +1481,11 @@ private:
     }
 
     void add_delay(EventID eid, TimeMs next_fire) {
+        // 固定容量且 delay_ops 已满时退化为立即生效，事件可能在本次 tick 中触发
+        if (is_full(delay_ops)) {
+            default_set_next_fire(eid, next_fire);
+            return;
+        }
         Op op;
         op.op_type = OpType::Delay;
         op.eid = eid;
@@ -178,98 +1497,206 @@ private:
         // Clear 操作应该在整个 delay_ops 中的首个位置
         assert(i == 0);
 
-        // 收集 resevered 槽位
-        Idxs reserved_indices;
+        // 标记 reserved 槽位
+        reserved.assign(events.size(), 0);
         for (size_t j = 1; j < ops.size(); ++j) {
             const Op &op = ops[j];
-            assert(op.op_type == OpType::Schedule);
-            reserved_indices.push_back(op.eid.index);
+            assert(op.op_type != OpType::Clear);
+            if (op.op_type == OpType::Schedule) reserved[op.eid.index] = 1;
         }
-        clear_in_tick(reserved_indices);
+        clear_in_tick();
     }
 
+    // 原地遍历，执行期间不会再产生新的 op
     void flush_delay_ops() {
-        Ops ops;
-        ops.swap(delay_ops); // 清空 delay_ops 同时仍能继续遍历
-        for (size_t i = 0; i < ops.size(); ++i) {
-            Op &op = ops[i];
-            if (op.op_type == OpType::Schedule) set_event(op.next_fire, std::move(op.desc), op.eid);
-            else if (op.op_type == OpType::Clear) handle_clear_op(ops, i);
+        for (size_t i = 0; i < delay_ops.size(); ++i) {
+            Op &op = delay_ops[i];
+            if (op.op_type == OpType::Schedule) set_event(op.next_fire, std::move(op.desc), op.eid, op.group);
+            else if (op.op_type == OpType::Clear) handle_clear_op(delay_ops, i);
+            else if (op.op_type == OpType::Resume) default_resume_group(op.group);
             else default_set_next_fire(op.eid, op.next_fire);
         }
+        delay_ops.clear();
+        settle_top();
     }
 
-    // 一个 tick 内只会执行一次
-    void clear_in_tick(const Idxs &reserved_indices) noexcept {
+    // 一个 tick 内只会执行一次，reserved 中标记的槽位不进入 free list
+    void clear_in_tick() noexcept {
         // 清空 pq
-        PQ tmp{EventCompare(events)};
-        pq.swap(tmp);
-
-        // 标记预定槽位
-        std::vector<uint8_t> reserved(events.size(), 0);
-        for (uint32_t idx : reserved_indices) {
-            assert(idx < reserved.size());
-            reserved[idx] = 1;
-        }
+        pq.clear();
 
+        note_clear(fl, &Snapshot::fl);
         fl.clear();
         fl.reserve(events.size());
 
         for (uint32_t i = 0; i < events.size(); ++i) {
-            Event &e = events[i];
+            Event &e = ev(i);
             e.status = EventStatus::Cancelled;
+            e.queued = false;
+            e.group = npos;
+            e.group_prev = npos;
+            e.group_next = npos;
             gens[i] += pending_clear; // 一次性加够
 
             // 只有未被预定的槽位可以进入 free list
             if (!reserved[i]) fl.push_back(i);
         }
 
+        reset_groups();
+        if constexpr (Traits.keyed) keys.clear();
+        reset_gc();
+        set_slot_count(events.size()); // 备用槽位也进入了 free list
+        next_seq = 0;
         alive = 0;
         cancelled = 0;
         fire_count = 0;
     }
 
     bool try_skip_repeat() {
-        EventID top = pq.top();
-        Event &e = events[top.index];
-        const Desc &d = e.desc;
+        if constexpr (!Traits.catchup) return false;
+        uint32_t idx = pq.top().index;
+        const Desc &d = events[idx].desc;
         if (d.type != EventType::Repeat) return false;
         if (d.cu != CatchUp::Latest) return false;
+        if (d.repeat == RepeatMode::Calendar) return false; // 没有固定周期，总是从 current 之后计算，不会落后多个周期
 
         // 把 Repeat 类的事件的 next_fire 更新到最后一次触发时刻
-        TimeMs delta = current - e.next_fire;
+        TimeMs delta = current - events[idx].next_fire;
         if (delta <= 0) return false;
         int64_t ts = static_cast<int64_t>(delta / d.interval_ms); // 周期
         if (ts == 0) return false;                                // 确保会被触发
 
         pq.pop();
+        Event &e = ev(idx);
+        e.queued = false;
         e.next_fire += ts * d.interval_ms;
-        pq.push(top);
+        push_event(idx);
         return true;
     }
 
     bool try_skip_old() {
-        EventID eid = pq.top();
-        if (eid.gen == gens[eid.index]) return false;
+        const Node &n = pq.top();
+        if (n.stamp == events[n.index].stamp) return false;
         pq.pop();
-        // 这里没有回收逻辑，因为可能 event 已经被更新为新版本
+        --stale_nodes;
+        // 这里没有回收逻辑，因为事件已经以新的节点入堆，或者槽位已经回收
         return true;
     }
 
-    void reschedule(EventID eid) noexcept {
+    // 持有快照时清理只丢弃旧节点：恢复后 pq 的布局与原来不同，按布局回收 cancel 的槽位会让重新执行时分配到不同的
+    // EventID。这时 cancel 的槽位等到堆顶再回收，回收顺序只取决于逻辑状态。没有快照时不会再恢复到之前的状态，照常回收
+    bool can_collect_cancelled() const noexcept {
+        if constexpr (Traits.snapshots) return journal.snaps.empty();
+        return true;
+    }
+
+    void reset_gc() noexcept {
+        stale_nodes = 0;
+        gc_cursor = 0;
+        gc_running = false;
+    }
+
+    // 垃圾足够多时开始一轮增量清理，每次调用最多检查 gc_policy.budget 个节点
+    void gc_step() {
+        if (gc_policy.budget == 0) return;
+        if (!gc_running) {
+            size_t garbage = stale_nodes + (can_collect_cancelled() ? cancelled : 0);
+            if (garbage < gc_policy.min_garbage) return;
+            if (static_cast<double>(garbage) <= gc_policy.max_garbage_ratio * static_cast<double>(pq.size())) return;
+            gc_running = true;
+            gc_cursor = pq.size();
+            ++gc_stats_.sweeps;
+        }
+        gc_cursor = pq.sweep([this](const Node &n) { return try_reuse(n); }, gc_cursor, gc_policy.budget);
+        if (gc_cursor == 0) gc_running = false;
+        settle_top();
+    }
+
+    // 同步重建的条件，只在关闭增量清理时使用
+    bool need_rebuild() const noexcept { return can_collect_cancelled() && gc_policy.budget == 0 && cancelled > alive; }
+
+    // cancel 之后的收尾：关闭增量清理时同步重建；否则在 tick 之外也推进一步增量清理，这样不 tick 的 schedule / cancel
+    // 循环中垃圾同样不会超过 max_garbage_ratio 太多。tick 中的 cancel 留给 tick 结束时的 gc_step
+    void collect_after_cancel() {
+        if (need_rebuild()) rebuild_pq();
+        else if (!ticking) gc_step();
+        settle_top();
+    }
+
+    void reschedule(EventID eid) {
         _assert_eid(eid);
-        Event &e = events[eid.index];
+        Event &e = ev(eid.index);
         assert(e.desc.type == EventType::Repeat);
-        e.next_fire += e.desc.interval_ms;
-        pq.push(eid);
+        e.next_fire = next_repeat_fire(e);
+        // Aligned / Calendar 事件的相位是语义的一部分，不加 jitter
+        if constexpr (Traits.jitter) {
+            const Desc &d = e.desc;
+            bool aligned = d.repeat == RepeatMode::Aligned || d.repeat == RepeatMode::Calendar;
+            if (d.jitter.max_ms > 0 && !aligned) e.next_fire += draw_jitter(d.jitter);
+        }
+        push_event(eid.index);
+    }
+
+    const CronExpr &calendar_of(const Desc &d) const noexcept
+        requires(Traits.calendar)
+    {
+        assert(d.repeat == RepeatMode::Calendar && d.calendar < calendars.size());
+        return calendars[d.calendar];
+    }
+
+    // 不早于 t 的第一个 iv 的整数倍
+    static TimeMs align_up(TimeMs t, TimeMs iv) noexcept {
+        TimeMs q = t / iv;
+        if (t % iv > 0) ++q; // 向上取整
+        return q * iv;
+    }
+
+    // Repeat 事件刚触发完，按 RepeatMode 计算下一次的触发时刻。tick 中 current 是本次 tick 结束的时刻；回调的执行
+    // 时间只有设置了 run_clock 才能看到，否则体现在下一次 tick 的 delta 中
+    TimeMs next_repeat_fire(const Event &e) const noexcept {
+        TimeMs iv = e.desc.interval_ms;
+        switch (e.desc.repeat) {
+        case RepeatMode::FixedDelay: return current + run_ms + iv;
+        case RepeatMode::Aligned: return align_up(current + 1, iv);
+        case RepeatMode::Calendar:
+            if constexpr (Traits.calendar) return calendar_of(e.desc).next_after(current);
+            assert(false); // 没有 calendar 特性时无法调度 Calendar 事件
+            [[fallthrough]];
+        default: return e.next_fire + iv;
+        }
+    }
+
+    // splitmix64：状态只有一个 uint64，拷贝、快照都很便宜
+    uint64_t next_random() noexcept {
+        uint64_t z = (jitter_rng += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // 关闭 jitter 特性时不会编译进来；开启时只有 max_ms > 0 的事件才会抽随机数
+    TimeMs draw_jitter(const Jitter &j) noexcept {
+        uint64_t r = next_random();
+        if (j.kind == JitterKind::Uniform) return static_cast<TimeMs>(r % (static_cast<uint64_t>(j.max_ms) + 1));
+        double u = static_cast<double>((r >> 11) + 1) * 0x1.0p-53; // (0, 1]
+        double x = -static_cast<double>(j.mean_ms) * std::log(u);
+        return static_cast<TimeMs>(std::min(x, static_cast<double>(j.max_ms)));
     }
 
     void default_clear() {
+        // 快照需要恢复被清掉的槽位，O(n) 与 clear 本身相同
+        if constexpr (Traits.snapshots)
+            for (uint32_t i = 0; i < events.size(); ++i) touch(i);
+        note_clear(fl, &Snapshot::fl);
+        next_seq = 0;
         events.clear();
-        PQ tmp{EventCompare(events)};
-        pq.swap(tmp);
+        pq.clear();
         fl.clear();
         gens.clear();
+        set_slot_count(0);
+        reset_groups();
+        if constexpr (Traits.keyed) keys.clear();
+        reset_gc();
         assert(delay_ops.empty());
         alive = 0;
         cancelled = 0;
@@ -278,51 +1705,49 @@ private:
     }
 
     void default_set_next_fire(EventID eid, TimeMs next_fire) {
-        Event &e = events[eid.index];
-        EventID new_id;
-        new_id.index = eid.index;
-        new_id.gen = eid.gen + 1;
-        ++gens[eid.index]; // 把堆中原有事件标记为旧事件
-        pq.push(new_id);   // 添加新的事件
-        e.next_fire = next_fire;
+        // 延后处理时事件可能已经被取消
+        if (!is_alive(eid)) return;
+        ev(eid.index).next_fire = next_fire;
+        push_event(eid.index); // 堆中原有节点自动成为旧节点
     }
 
-    template <typename F>
-    static constexpr bool is_valid_callback_t =
-        std::is_constructible_v<Callback, F> &&
-        (std::is_invocable_r_v<void, F &> || std::is_invocable_r_v<void, F &, EventID>);
-
-public:
-    EventScheduler() : events(), pq(EventCompare(events)) {}
-    ~EventScheduler() {}
-
-    EventScheduler(const EventScheduler &) = delete;
-    EventScheduler &operator=(const EventScheduler &) = delete;
-    EventScheduler(EventScheduler &&) = delete;
-    EventScheduler &operator=(EventScheduler &&) = delete;
+    // 触发后的收尾：回收，或者重新调度 Repeat 事件
+    void finish_fire(EventID eid) {
+        Event &e = ev(eid.index);
+        if (e.desc.type != EventType::Repeat || e.status == EventStatus::Cancelled) reuse(eid);
+        else if (e.status == EventStatus::Paused) e.paused_left = next_repeat_fire(e) - current;
+        else reschedule(eid);
+    }
 
-    template <typename F>
-    EventID schedule_after(TimeMs time_ms, F &&f, EventType type = EventType::Once, TimeMs interval_ms = TimeMs{},
-                           ExceptionPolicy ep = ExceptionPolicy::Swallow, EventPriority pri = EventPriority::User,
-                           CatchUp cu = CatchUp::All) {
+    template <typename F> EventID schedule_impl(TimeMs next_fire, F &&f, uint32_t group, const Desc &proto) {
         static_assert(is_valid_callback_t<F>,
-                      "callback must be invocable with signature void() / void(EventID)，而且能用于构造 Callback 对象");
-        assert(!(type == EventType::Repeat && interval_ms <= 0)); // 防止同一 tick 重复触发某一 Repeat 事件
+                      "callback must be invocable with signature void() / void(EventID) / void(void *, uint64_t, EventID)，"
+                      "而且能用于构造 Callback 对象；Callback 为 HandlerCall 时只能传入 HandlerCall");
+        // 防止同一 tick 重复触发某一 Repeat 事件
+        assert(!(proto.type == EventType::Repeat && proto.repeat != RepeatMode::Calendar && proto.interval_ms <= 0));
+        assert(Traits.calendar || proto.repeat != RepeatMode::Calendar);
+
+        // 固定容量用完时先回收等待清理的 cancel 槽位，仍然没有空位才失败
+        if (fl.empty() && is_full(events) && cancelled > 0) rebuild_pq();
+        if (fl.empty() && is_full(events)) return EventID::invalid();
+        if (ticking && is_full(delay_ops)) return EventID::invalid();
 
         // 获取事件最终的 eid
         EventID eid;
         if (fl.empty()) eid = append();
         else eid = pop_fl();
 
-        Desc d;
-        d.type = type;
-        d.interval_ms = interval_ms;
-        d.callback = std::move(Callback(std::forward<F>(f)));
-        d.ep = ep;
-        d.pri = pri;
-        d.cu = cu;
-
-        TimeMs next_fire = current + time_ms;
+        Desc d{.type = proto.type,
+               .repeat = proto.repeat,
+               .interval_ms = proto.interval_ms,
+               .callback = make_callback(alloc, std::forward<F>(f)),
+               .ep = proto.ep,
+               .pri = proto.pri,
+               .cu = proto.cu,
+               .key = proto.key,
+               .jitter = default_jitter,
+               .calendar = proto.calendar,
+               .slack_ms = default_slack};
 
         // 处理 ticking clear 带来的 gen 偏移
         assert(!(ticking == false && pending_clear != 0));
@@ -330,139 +1755,739 @@ public:
         eid.gen += pending_clear;
         // 不给 gens 加偏移，因为 flush 的时候会加上
 
-        if (ticking) add_schedule(next_fire, std::move(d), eid);
-        else set_event(next_fire, std::move(d), eid);
+        if (ticking) add_schedule(next_fire, std::move(d), eid, group);
+        else set_event(next_fire, std::move(d), eid, group);
         return eid;
     }
 
+    // priority_bits 小于 8 时 EventPriority 的别名超出范围，按比例缩放到 [0, pri_limit)：System / User / Debug
+    // 分别是 0、中点和最大值。范围内的整数优先级不变
+    static constexpr Priority fit_priority(Priority pri) noexcept {
+        if constexpr (Traits.priority_bits < 8)
+            if (pri.level >= pri_limit && pri.level <= static_cast<uint32_t>(EventPriority::Debug))
+                return Priority{pri.level >> (8 - Traits.priority_bits)};
+        return pri;
+    }
+
+    static Desc make_proto(EventType type, TimeMs interval_ms, ExceptionPolicy ep, Priority pri, CatchUp cu) {
+        Desc d;
+        d.type = type;
+        d.interval_ms = interval_ms;
+        d.ep = ep;
+        d.pri = fit_priority(pri);
+        d.cu = cu;
+        return d;
+    }
+
+    // pq 中的节点是否对应一个会触发的事件
+    bool is_live_node(const Node &n) const noexcept {
+        const Event &e = events[n.index];
+        return n.stamp == e.stamp && e.status == EventStatus::Alive;
+    }
+
+    // 按触发顺序遍历 pq 中的节点，f 返回 false 时停止，开销与遍历到的节点数有关
+    template <typename F> void walk_pq(F &&f) const {
+        pq.walk(std::forward<F>(f), frontier); // frontier 是成员，反复调用不需要分配
+    }
+
+    template <typename F>
+    static constexpr bool is_valid_callback_t =
+        std::is_constructible_v<Callback, F> &&
+        (std::is_invocable_r_v<void, F &> || std::is_invocable_r_v<void, F &, EventID> ||
+         std::is_invocable_r_v<void, F &, void *, uint64_t, EventID> || // FnCallback::Fn，ctx 和 arg 为空
+         (is_handler_call_v<Callback> && std::is_same_v<std::remove_cvref_t<F>, Callback>));
+
+public:
+    BasicEventScheduler() : BasicEventScheduler(Alloc{}) {}
+    explicit BasicEventScheduler(const Alloc &a)
+        : alloc(a), events(a), pq(a), fl(a), gens(a), delay_ops(a), groups(a), group_fl(a), reserved(a),
+          frontier(a), handlers(a), calendars(a), journal(a), keys(a), load(a) {}
+    ~BasicEventScheduler() {}
+
+    // pq 不再引用 events，可以拷贝和移动，但不能在 tick 中进行
+    BasicEventScheduler(const BasicEventScheduler &) = default;
+    BasicEventScheduler &operator=(const BasicEventScheduler &) = default;
+    BasicEventScheduler(BasicEventScheduler &&) = default;
+    BasicEventScheduler &operator=(BasicEventScheduler &&) = default;
+
+    // 拷贝出一个独立的调度器用于推演，之后两者互不影响。代价取决于存储：
+    //   DynamicStorage / InlineStorage：完整拷贝所有容器和回调，O(n)
+    //   CowStorage：每个内部容器只共享块表，与事件数无关；标量成员照常拷贝，compact_hook / run_clock 两个 std::function
+    //   也会拷贝（可能分配）。之后每个容器第一次被写时复制块表（O(n / ChunkSize)），再复制写到的块
+    // 回调随槽位一起拷贝，捕获的指针仍然指向同一对象，推演时应使用处理函数或只按值捕获。不能在 tick 中调用
+    BasicEventScheduler fork() const
+        requires(std::is_copy_constructible_v<Callback>)
+    {
+        assert(!ticking);
+        return *this;
+    }
+
+    template <typename F>
+    EventID schedule_after(TimeMs time_ms, F &&f, EventType type = EventType::Once, TimeMs interval_ms = TimeMs{},
+                           ExceptionPolicy ep = ExceptionPolicy::Swallow, Priority pri = EventPriority::User,
+                           CatchUp cu = CatchUp::All) {
+        TimeMs next_fire = current + time_ms;
+        if constexpr (!Storage::fixed)
+            if (smoothing.window > 0 && type == EventType::Repeat) next_fire = smooth_first_fire(next_fire, interval_ms);
+        return schedule_impl(next_fire, std::forward<F>(f), npos, make_proto(type, interval_ms, ep, pri, cu));
+    }
+
     template <typename F>
     EventID schedule_at(TimeMs time_ms, F &&f, EventType type = EventType::Once, TimeMs interval_ms = TimeMs{},
-                        ExceptionPolicy ep = ExceptionPolicy::Swallow, EventPriority pri = EventPriority::User,
+                        ExceptionPolicy ep = ExceptionPolicy::Swallow, Priority pri = EventPriority::User,
                         CatchUp cu = CatchUp::All) {
-        return schedule_after(time_ms - current, std::forward<F>(f), type, interval_ms, ep, pri, cu);
+        // 绝对时间不做负载平滑
+        return schedule_impl(time_ms, std::forward<F>(f), npos, make_proto(type, interval_ms, ep, pri, cu));
     }
 
     template <typename F>
     EventID schedule(TimeMs time_ms, F &&f, TimeMode mode = TimeMode::Relative, EventType type = EventType::Once,
                      TimeMs interval_ms = TimeMs{}, ExceptionPolicy ep = ExceptionPolicy::Swallow,
-                     EventPriority pri = EventPriority::User, CatchUp cu = CatchUp::All) {
+                     Priority pri = EventPriority::User, CatchUp cu = CatchUp::All) {
         if (mode == TimeMode::Relative)
             return schedule_after(time_ms, std::forward<F>(f), type, interval_ms, ep, pri, cu);
         return schedule_at(time_ms, std::forward<F>(f), type, interval_ms, ep, pri, cu);
     }
 
+    // 调度事件并加入组，组内事件触发/取消后自动离开组
+    template <typename F>
+    EventID schedule_in(GroupID g, TimeMs time_ms, F &&f, TimeMode mode = TimeMode::Relative,
+                        EventType type = EventType::Once, TimeMs interval_ms = TimeMs{},
+                        ExceptionPolicy ep = ExceptionPolicy::Swallow, Priority pri = EventPriority::User,
+                        CatchUp cu = CatchUp::All) {
+        assert(is_group(g));
+        TimeMs next_fire = mode == TimeMode::Relative ? current + time_ms : time_ms;
+        return schedule_impl(next_fire, std::forward<F>(f), g.index, make_proto(type, interval_ms, ep, pri, cu));
+    }
+
+    // === 按 key 调度：每个 key 最多对应一个活跃事件，事件触发结束或被 cancel 后自动解除，不需要在外部维护 key -> EventID
+
+    // key 已有活跃事件时先 cancel，再调度新的事件，返回新的 EventID。tick 中调用时新事件在 tick 结束时生效，
+    // 同一 tick 中对同一 key 多次调用，最后一次生效
+    template <typename F>
+    EventID schedule_or_replace(uint64_t key, TimeMs time_ms, F &&f, TimeMode mode = TimeMode::Relative,
+                                EventType type = EventType::Once, TimeMs interval_ms = TimeMs{},
+                                ExceptionPolicy ep = ExceptionPolicy::Swallow, Priority pri = EventPriority::User,
+                                CatchUp cu = CatchUp::All)
+        requires(Traits.keyed)
+    {
+        assert(key != no_key);
+        cancel_by_key(key);
+        Desc proto = make_proto(type, interval_ms, ep, pri, cu);
+        proto.key = key;
+        TimeMs next_fire = mode == TimeMode::Relative ? current + time_ms : time_ms;
+        return schedule_impl(next_fire, std::forward<F>(f), npos, proto);
+    }
+
+    bool cancel_by_key(uint64_t key) noexcept
+        requires(Traits.keyed)
+    {
+        uint32_t idx = keys.find(key);
+        return idx != npos && cancel(id_of(idx));
+    }
+
+    // key 对应的活跃事件，没有时返回 EventID::invalid()
+    EventID find(uint64_t key) const noexcept
+        requires(Traits.keyed)
+    {
+        uint32_t idx = keys.find(key);
+        return idx == npos ? EventID::invalid() : id_of(idx);
+    }
+
+    size_t num_keys() const noexcept
+        requires(Traits.keyed)
+    {
+        return keys.size();
+    }
+
+    // === 事件组：以下接口的开销只与组的大小有关
+
+    // 固定容量用完时返回 GroupID::invalid()
+    GroupID create_group() {
+        uint32_t idx;
+        if (group_fl.empty() && is_full(groups)) return GroupID::invalid();
+        if (group_fl.empty()) {
+            idx = static_cast<uint32_t>(groups.size());
+            groups.emplace_back();
+            if constexpr (Traits.snapshots) journal.group_epoch.push_back(0);
+        } else {
+            idx = group_fl.back();
+            note_pop(group_fl, &Snapshot::group_fl);
+            group_fl.pop_back();
+        }
+        Group &gr = grp(idx);
+        gr.used = true;
+        return GroupID{idx, gr.gen};
+    }
+
+    // 取消组内全部事件并回收组，旧的 GroupID 失效
+    void destroy_group(GroupID g) noexcept {
+        if (!is_group(g)) return;
+        cancel_group(g);
+        Group &gr = grp(g.index);
+        gr.used = false;
+        gr.paused = false;
+        ++gr.gen;
+        group_fl.push_back(g.index);
+    }
+
+    // 取消组内全部事件，返回被取消的数量
+    size_t cancel_group(GroupID g) noexcept {
+        if (!is_group(g)) return 0;
+        const Group &gr = groups[g.index];
+        size_t n = 0;
+        while (gr.head != npos) {
+            cancel_slot(gr.head);
+            ++n;
+        }
+        // 整组取消完之后最多重建一次
+        collect_after_cancel();
+        return n;
+    }
+
+    // 暂停组内事件，暂停期间组内事件的剩余时间保持不变
+    void pause_group(GroupID g) noexcept
+        requires(Traits.pause)
+    {
+        if (!is_group(g) || groups[g.index].paused) return;
+        Group &gr = grp(g.index);
+        gr.paused = true;
+        for (uint32_t idx = gr.head; idx != npos; idx = events[idx].group_next) {
+            Event &e = ev(idx);
+            if (e.status != EventStatus::Alive) continue;
+            e.status = EventStatus::Paused;
+            e.paused_left = e.next_fire - current;
+            // pq 中的节点留到堆顶时再丢弃
+        }
+        settle_top();
+    }
+
+    // 恢复组内事件，tick 中恢复的事件最早在下一次 tick 触发
+    void resume_group(GroupID g)
+        requires(Traits.pause)
+    {
+        if (!is_group(g)) return;
+        if (ticking) add_resume(g.index);
+        else default_resume_group(g.index);
+    }
+
+    // 组内所有事件推迟 ms，可以传入负数
+    void delay_group(GroupID g, TimeMs ms) {
+        if (!is_group(g) || ms == 0) return;
+        const Group &gr = groups[g.index];
+        for (uint32_t idx = gr.head; idx != npos; idx = events[idx].group_next) {
+            const Event &e = events[idx];
+            if (e.status == EventStatus::Paused) ev(idx).paused_left += ms;
+            else move_event(id_of(idx), e.next_fire + ms);
+        }
+    }
+
+    size_t group_size(GroupID g) const noexcept { return is_group(g) ? groups[g.index].size : 0; }
+    bool is_group_paused(GroupID g) const noexcept { return is_group(g) && groups[g.index].paused; }
+
     void fire_top() {
         ++fire_count;
-        EventID top = pq.top();
+        Node n = pq.top();
         pq.pop();
-        Event &e = events[top.index];
+        if (n.stamp != events[n.index].stamp) {
+            --stale_nodes;
+            return;
+        }
+        Event &e = ev(n.index);
         Desc &d = e.desc;
-
+        e.queued = false;
+        if (e.status == EventStatus::Cancelled) {
+            --cancelled;
+            recycle(n.index);
+            return;
+        }
         if (e.status != EventStatus::Alive) return;
-
-        try {
-            // call 后事件不一定仍为 Alive
+        EventID top = id_of(n.index);
+        if constexpr (!Storage::fixed)
+            if (smoothing.window > 0 && d.type == EventType::Repeat) note_load(e.next_fire);
+
+        // FixedDelay 从回调结束时重新计时，回调的执行时间由 run_clock 测量
+        bool timed = d.type == EventType::Repeat && d.repeat == RepeatMode::FixedDelay && run_clock;
+        TimeMs started = timed ? run_clock() : TimeMs{};
+        firing = top.index;
+        // call 后事件不一定仍为 Alive
+        if constexpr (Traits.exceptions) {
+            try {
+                call(d.callback, top);
+            } catch (...) {
+                // 若在此处捕获，说明 Policy 为 rethrow
+                firing = npos;
+                run_ms = timed ? run_clock() - started : TimeMs{};
+                finish_fire(top);
+                throw;
+            }
+        } else {
             call(d.callback, top);
-        } catch (...) {
-            // 若在此处捕获，说明 Policy 为 rethrow
-            if (d.type == EventType::Repeat && e.status != EventStatus::Cancelled) reschedule(top);
-            else reuse(top);
-            throw;
         }
-        if (d.type == EventType::Repeat && e.status != EventStatus::Cancelled) reschedule(top);
-        else reuse(top);
+        firing = npos;
+        run_ms = timed ? run_clock() - started : TimeMs{};
+        finish_fire(top);
+    }
+
+    // 注册处理函数，Fn 的签名为 void(const P &) 或 void(const P &, EventID)，P 是可平凡拷贝的负载类型。HandlerId 按
+    // 注册顺序分配，以同样的顺序注册的调度器可以互相重放事件。固定容量时最多注册 N 个
+    template <auto Fn>
+    HandlerId register_handler()
+        requires(is_handler_call_v<Callback>)
+    {
+        using P = typename handler_traits<decltype(Fn)>::payload;
+        static_assert(Callback::template is_payload_v<P>, "负载必须可平凡拷贝，且不超过 HandlerCall 的负载大小");
+        assert(!is_full(handlers));
+        handlers.push_back([](const std::byte *payload, EventID eid) {
+            P p;
+            std::memcpy(&p, payload, sizeof(P));
+            if constexpr (std::is_invocable_v<decltype(Fn), const P &, EventID>) Fn(p, eid);
+            else Fn(p);
+        });
+        return static_cast<HandlerId>(handlers.size() - 1);
+    }
+
+    size_t num_handlers() const noexcept
+        requires(is_handler_call_v<Callback>)
+    {
+        return handlers.size();
+    }
+
+    // 注册日历表达式，相同的表达式返回同一个 id。CalendarId 只在同一个调度器（及其拷贝）中有意义，固定容量时最多注册
+    // N 个
+    CalendarId add_calendar(const CronExpr &expr)
+        requires(Traits.calendar)
+    {
+        for (size_t i = 0; i < calendars.size(); ++i)
+            if (calendars[i] == expr) return static_cast<CalendarId>(i);
+        assert(!is_full(calendars));
+        calendars.push_back(expr);
+        return static_cast<CalendarId>(calendars.size() - 1);
+    }
+
+    size_t num_calendars() const noexcept
+        requires(Traits.calendar)
+    {
+        return calendars.size();
+    }
+
+    // 调度日历事件：在 now() 之后每次匹配日历时触发。它是 RepeatMode::Calendar 的 Repeat 事件，每次触发后与其它
+    // Repeat 事件一样在 reschedule 中计算下一次的时刻
+    template <typename F>
+    EventID schedule_calendar(CalendarId cal, F &&f, ExceptionPolicy ep = ExceptionPolicy::Swallow,
+                              Priority pri = EventPriority::User)
+        requires(Traits.calendar)
+    {
+        assert(cal < calendars.size());
+        Desc proto = make_proto(EventType::Repeat, TimeMs{}, ep, pri, CatchUp::All);
+        proto.repeat = RepeatMode::Calendar;
+        proto.calendar = cal;
+        return schedule_impl(calendars[cal].next_after(current), std::forward<F>(f), npos, proto);
     }
 
     // 取消事件，若已经非活跃，返回 false
     bool cancel(EventID eid) noexcept {
         if (!eid.is_valid() || !is_alive(eid)) return false;
-        Event &e = events[eid.index];
+        const Event &e = events[eid.index];
         if (e.status == EventStatus::Cancelled) return false;
-        events[eid.index].status = EventStatus::Cancelled;
-        // 不要在这里回收，如更新 fl 和 gen 等
-        --alive;
-        ++cancelled;
-        if (cancelled > alive) rebuild_pq();
+        cancel_slot(eid.index);
+        collect_after_cancel();
         return true;
     }
 
+    // 丢弃旧节点并回收 cancel 节点，O(n)
     void rebuild_pq() {
-        size_t old_pq_size = pq.size();
-        size_t old_fl_size = fl.size();
-        PQ tmp{EventCompare(events)};
-        while (!pq.empty()) {
-            EventID eid = pq.top();
-            pq.pop();
-            if (!try_reuse(eid)) tmp.push(eid);
-        }
-        pq.swap(tmp);
-        assert(old_pq_size - pq.size() == fl.size() - old_fl_size);
-        cancelled = 0;
+        pq.erase_if([this](const Node &n) { return try_reuse(n); });
+        assert(cancelled == 0 && stale_nodes == 0);
+        gc_running = false;
     }
 
-    // 事件是否活跃，是否非旧事件
+    // 事件是否活跃（暂停也算），是否非旧事件
     bool is_alive(EventID eid) const noexcept {
         if (static_cast<size_t>(eid.index) >= events.size()) return false;
         if (eid.gen != gens[eid.index]) return false;
         const Event &e = events[eid.index];
-        return e.status == EventStatus::Alive;
+        return e.status != EventStatus::Cancelled;
     }
 
     // 推进时间
     void tick(TimeMs delta_ms) {
         assert(!ticking);
         if (try_update_pause(delta_ms)) return;
+        tick_events(delta_ms);
+        gc_step();
+        maybe_compact();
+    }
+
+private:
+    void tick_events(TimeMs delta_ms) {
         TickGuard tg(this); // RAII guard
         current += delta_ms;
+        bool woke = false;
+        TimeMs last_fire{};
         while (!pq.empty()) {
+            if (try_skip_old()) continue;      // 跳过旧节点，注意顺序
             if (try_pop_cancelled()) continue; // 处理 Cancelled 堆顶
-            if (try_skip_old()) continue;      // 跳过旧事件，注意顺序
+            if (try_pop_paused()) continue;    // 暂停组的事件等恢复时再入堆
             if (try_skip_repeat()) continue;   // CatchUp = Latest 时，跳过重复 repeat 事件
 
-            EventID top = pq.top();
-            const Event &e = events[top.index];
+            const Event &e = events[pq.top().index];
 
             if (current < e.next_fire) break;
+            if (!woke) ++wakeup_stats_.wakeups;
+            if (!woke || e.next_fire != last_fire) ++wakeup_stats_.deadlines;
+            woke = true;
+            last_fire = e.next_fire;
             fire_top();
         }
     }
 
+    void maybe_compact() {
+        if constexpr (!Storage::fixed) {
+            if (!auto_compact) return;
+            if (events.size() <= compact_policy.min_slots) return;
+            if (events.size() <= compact_policy.slots_per_alive * alive) return;
+            compact([this](EventID old_id, EventID new_id) {
+                if (compact_hook) compact_hook(old_id, new_id);
+            });
+        }
+    }
+
+public:
     void tick_until(TimeMs end_time) {
         if (end_time <= current) return;
         TimeMs delta_ms = end_time - current;
         tick(delta_ms);
     }
 
-    // 获取最近事件的 id 和触发时间
+    // 获取最近事件的 id 和触发时间，tick 之外堆顶总是一个会触发的事件
     auto peek() const noexcept -> std::optional<std::pair<EventID, TimeMs>> {
         if (pq.empty()) return std::nullopt;
-        EventID eid = pq.top();
-        const Event &e = events[eid.index];
-        return {eid, e.next_fire};
+        const Node &n = pq.top();
+        return std::make_pair(id_of(n.index), n.next_fire);
+    }
+
+    // 最近一个会触发的事件的时间。schedule / cancel / delay / 触发时都会清理堆顶，所以是 O(1)
+    // tick 中调用时不包含本次 tick 中 schedule 的事件
+    std::optional<TimeMs> next_deadline() const noexcept {
+        if (pq.empty()) return std::nullopt;
+        return pq.top().next_fire;
+    }
+
+    // next_fire <= until 的事件数量，开销与这些事件的数量有关
+    size_t due_count(TimeMs until) const {
+        size_t n = 0;
+        walk_pq([&](const Node &nd) {
+            if (nd.next_fire > until) return false;
+            if (is_live_node(nd)) ++n;
+            return true;
+        });
+        return n;
+    }
+
+    // 按触发顺序访问 next_fire 在 [from, until) 内的活跃事件，f(EventID, next_fire) 返回 false 时提前结束。跳过 cancel、
+    // 暂停的事件和旧节点；开销为 O((k + m) log n)，k 是遍历到的节点数，m 是早于 from 的节点数，from 取 now() 时 m 很小。
+    // tick 中调用时不包含本次 tick 中 schedule 的事件
+    template <typename F> void for_each_between(TimeMs from, TimeMs until, F &&f) const {
+        walk_pq([&](const Node &nd) {
+            if (nd.next_fire >= until) return false;
+            if (nd.next_fire < from || !is_live_node(nd)) return true;
+            if constexpr (std::is_same_v<std::invoke_result_t<F &, EventID, TimeMs>, bool>)
+                return f(id_of(nd.index), nd.next_fire);
+            else f(id_of(nd.index), nd.next_fire);
+            return true;
+        });
+    }
+
+    // next_fire 在 [from, until) 内的活跃事件数量
+    size_t count_between(TimeMs from, TimeMs until) const {
+        size_t n = 0;
+        for_each_between(from, until, [&](EventID, TimeMs) { ++n; });
+        return n;
     }
 
+    // 合并 slack 窗口重叠的事件后的下一次唤醒时间：在这个时刻 tick 能一次触发尽可能多的事件，且没有事件超出自己的
+    // slack 窗口。开销与窗口内的节点数有关
+    std::optional<TimeMs> next_wakeup() const
+        requires(Traits.slack)
+    {
+        std::optional<TimeMs> wake;
+        walk_pq([&](const Node &n) {
+            if (!is_live_node(n)) return true;
+            const Event &e = events[n.index];
+            if (wake && e.next_fire > *wake) return false;
+            TimeMs w = e.next_fire + e.desc.slack_ms;
+            if (!wake || w < *wake) wake = w;
+            return true;
+        });
+        return wake;
+    }
+
+    // 依次触发所有事件，current 跳到每个事件的触发时间。batch_run 时先把 pq 一次性排序
     void run() {
         assert(!ticking);
         if (paused) return;
+        if constexpr (Traits.batch_run) pq.sort_all();
+        run_events();
+        gc_step();
+        maybe_compact();
+    }
+
+private:
+    void run_events() {
         TickGuard tg(this);
         while (!pq.empty()) {
+            if (try_skip_old()) continue;
             if (try_pop_cancelled()) continue;
+            if (try_pop_paused()) continue;
             if (try_skip_repeat()) continue;
-            if (try_skip_old()) continue;
 
-            EventID top = pq.top();
-            const Event &e = events[top.index];
+            const Event &e = events[pq.top().index];
 
             current = e.next_fire;
             fire_top();
         }
     }
 
+public:
+    // 把活跃和暂停的事件搬到低位槽位，并把多余的内存还给分配器，返回释放的槽位数。on_move(old, new) 用于更新外部
+    // 保存的 EventID。压缩后的 gen 都不小于 gen_floor，而 gen_floor 大于所有旧的 gen，所以旧 EventID 永远不会再次生效。
+    // 不能在 tick 中调用，固定容量的调度器没有内存可以归还
+    template <typename F>
+    size_t compact(F &&on_move)
+        requires(!Storage::fixed)
+    {
+        assert(!ticking);
+        assert(delay_ops.empty());
+
+        Gens old_gens(alloc);
+        old_gens.swap(gens);
+        for (uint32_t g : old_gens) gen_floor = std::max(gen_floor, g + 1);
+
+        size_t old_size = events.size();
+        Idxs remap(old_size, npos, alloc);
+        Events moved(alloc);
+        for (uint32_t i = 0; i < old_size; ++i) {
+            Event &e = events[i];
+            if (e.status == EventStatus::Cancelled) continue;
+            remap[i] = static_cast<uint32_t>(moved.size());
+            moved.emplace_back(std::move(e));
+        }
+        events.swap(moved);
+        Events(alloc).swap(moved);
+
+        // 修正组链表，重新建堆
+        for (Event &e : events) {
+            if (e.group_prev != npos) e.group_prev = remap[e.group_prev];
+            if (e.group_next != npos) e.group_next = remap[e.group_next];
+            e.stamp = 0;
+            e.queued = false;
+        }
+        for (Group &gr : groups)
+            if (gr.head != npos) gr.head = remap[gr.head];
+        if constexpr (Traits.keyed) {
+            keys.clear();
+            for (uint32_t i = 0; i < events.size(); ++i)
+                if (events[i].desc.key != no_key) keys.assign(events[i].desc.key, i);
+        }
+        Gens(events.size(), gen_floor, alloc).swap(gens);
+        FL(alloc).swap(fl);
+        Ops(alloc).swap(delay_ops);
+        pq = PQ(alloc);
+        reset_gc();
+        cancelled = 0;
+        for (uint32_t i = 0; i < events.size(); ++i)
+            if (events[i].status == EventStatus::Alive) push_event(i);
+
+        for (uint32_t i = 0; i < old_size; ++i)
+            if (remap[i] != npos) on_move(EventID{i, old_gens[i]}, EventID{remap[i], gen_floor});
+        if constexpr (Traits.snapshots) {
+            release_states_before(std::numeric_limits<StateId>::max()); // 槽位已经搬动，快照全部失效
+            journal.slot_epoch.assign(events.size(), 0);
+            set_slot_count(events.size());
+        }
+        return old_size - events.size();
+    }
+
+    size_t compact()
+        requires(!Storage::fixed)
+    {
+        return compact([](EventID, EventID) {});
+    }
+
+    // 开启自动压缩，on_move 会收到每个被搬动的事件的新旧 EventID
+    void set_compact_policy(CompactPolicy policy, std::function<void(EventID, EventID)> on_move = {})
+        requires(!Storage::fixed)
+    {
+        assert(policy.slots_per_alive >= 1);
+        compact_policy = policy;
+        compact_hook = std::move(on_move);
+        auto_compact = true;
+    }
+
+    void disable_auto_compact() noexcept { auto_compact = false; }
+
+    // === 快照：保存之后每个槽位 / 组第一次被修改前的旧值，恢复的开销与两次之间修改过的槽位数有关，与事件总数无关。
+    // 不能在 tick 中调用。回调对象随槽位一起保存和恢复；注册的处理函数、GC / 压缩策略不属于快照。compact 会丢弃所有快照
+
+    // 保存当前状态，返回的 id 单调递增
+    StateId save_state()
+        requires(Traits.snapshots)
+    {
+        assert(!ticking);
+        Journal &j = journal;
+        Snapshot &s = j.snaps.emplace_back(alloc);
+        s.epoch = ++j.epoch;
+        s.current = current;
+        s.paused_time = paused_time_;
+        s.default_slack = default_slack;
+        s.default_jitter = default_jitter;
+        s.jitter_rng = jitter_rng;
+        s.wakeup = wakeup_stats_;
+        s.alive = alive;
+        s.fire_count = fire_count;
+        s.slot_count = j.slot_count;
+        s.groups_size = groups.size();
+        s.next_seq = next_seq;
+        s.gen_floor = gen_floor;
+        s.paused = paused;
+        s.fl.size = s.fl.low = fl.size();
+        s.group_fl.size = s.group_fl.low = group_fl.size();
+        return j.first_id + j.snaps.size() - 1;
+    }
+
+    // 回到快照 id 保存时的状态。之后的快照被丢弃，id 本身仍然有效，可以再次恢复。快照之后新建的槽位留作备用，
+    // 按原来的顺序重新分配，所以重新执行同样的操作会得到同样的 EventID
+    void restore_state(StateId id)
+        requires(Traits.snapshots)
+    {
+        assert(!ticking);
+        Journal &j = journal;
+        assert(id >= j.first_id && id - j.first_id < j.snaps.size());
+        size_t pos = static_cast<size_t>(id - j.first_id);
+        uint32_t mark = ++j.epoch;
+        j.restored.clear();
+        // 每个槽位第一次恢复时，它在 pq 中的节点都变为旧节点，之后按恢复的状态重新入堆
+        auto take = [&](uint32_t idx) {
+            if (j.slot_epoch[idx] == mark) return;
+            j.slot_epoch[idx] = mark;
+            drop_key(idx);
+            const Event &e = events[idx];
+            if (e.queued) {
+                ++stale_nodes;
+                if (e.status == EventStatus::Cancelled) --cancelled;
+            }
+            j.restored.emplace_back(idx, e.stamp);
+        };
+        for (size_t k = j.snaps.size(); k-- > pos;) {
+            Snapshot &s = j.snaps[k];
+            while (events.size() < s.slot_count) { // clear 之后槽位可能比快照时少
+                events.emplace_back(alloc);
+                gens.emplace_back(0);
+                if (j.slot_epoch.size() < events.size()) j.slot_epoch.push_back(0);
+            }
+            for (uint32_t i = static_cast<uint32_t>(s.slot_count); i < j.slot_count; ++i) {
+                take(i);
+                events[i] = Event(alloc);
+            }
+            for (SlotUndo &u : s.slots) {
+                take(u.index);
+                events[u.index] = std::move(u.event);
+                gens[u.index] = u.gen;
+            }
+            for (GroupUndo &u : s.groups) groups[u.index] = u.group;
+            groups.resize(s.groups_size);
+            j.group_epoch.resize(s.groups_size);
+            restore_stack(fl, s.fl);
+            restore_stack(group_fl, s.group_fl);
+            j.slot_count = s.slot_count;
+            current = s.current;
+            paused_time_ = s.paused_time;
+            default_slack = s.default_slack;
+            default_jitter = s.default_jitter;
+            jitter_rng = s.jitter_rng;
+            wakeup_stats_ = s.wakeup;
+            alive = s.alive;
+            fire_count = s.fire_count;
+            next_seq = s.next_seq;
+            gen_floor = s.gen_floor;
+            paused = s.paused;
+        }
+        while (j.snaps.size() > pos + 1) j.snaps.pop_back();
+        Snapshot &s = j.snaps.back();
+        s.slots.clear();
+        s.groups.clear();
+        s.fl = StackUndo{fl.size(), fl.size(), std::move(s.fl.popped)};
+        s.fl.popped.clear();
+        s.group_fl = StackUndo{group_fl.size(), group_fl.size(), std::move(s.group_fl.popped)};
+        s.group_fl.popped.clear();
+
+        // 重新入堆。此时快照的 epoch 与恢复标记相同，不会把入堆的修改记进 undo log
+        s.epoch = mark;
+        for (auto [idx, stamp] : j.restored) {
+            Event &e = events[idx];
+            e.stamp = stamp + 1; // 比 pq 中该槽位的所有节点都新
+            if constexpr (Traits.keyed)
+                if (e.status != EventStatus::Cancelled && e.desc.key != no_key) keys.assign(e.desc.key, idx);
+            if (!e.queued) continue;
+            e.queued = false;
+            push_event(idx);
+            if (e.status == EventStatus::Cancelled) ++cancelled;
+        }
+        s.epoch = ++j.epoch;
+        settle_top();
+    }
+
+    // 丢弃早于 id 的快照，回收它们的 undo log。全部丢弃后，之前留在 pq 中的 cancel 节点照常清理
+    void release_states_before(StateId id)
+        requires(Traits.snapshots)
+    {
+        Journal &j = journal;
+        while (!j.snaps.empty() && j.first_id < id) {
+            j.snaps.pop_front();
+            ++j.first_id;
+        }
+        if (j.snaps.empty() && !ticking) collect_after_cancel();
+    }
+
+    size_t num_states() const noexcept
+        requires(Traits.snapshots)
+    {
+        return journal.snaps.size();
+    }
+
     TimeMs now() const noexcept { return current; }
     TimeMs paused_time() const noexcept { return paused_time_; }
     size_t size() const noexcept { return alive; }
     size_t num_cancelled() const noexcept { return cancelled; }
     size_t num_pending_clear() const noexcept { return pending_clear; }
+    const WakeupStats &wakeup_stats() const noexcept { return wakeup_stats_; }
+
+    GcStats gc_stats() const noexcept {
+        GcStats st = gc_stats_;
+        st.nodes = pq.size();
+        st.stale = stale_nodes;
+        st.cancelled = cancelled;
+        return st;
+    }
+
+    void set_gc_policy(GcPolicy policy) noexcept {
+        assert(policy.max_garbage_ratio >= 0);
+        gc_policy = policy;
+    }
+
+    // 开启或关闭 Repeat 事件的负载平滑，重新设置时直方图从零开始统计
+    void set_smoothing_policy(SmoothingPolicy policy)
+        requires(!Storage::fixed)
+    {
+        assert(policy.window >= 0 && policy.horizon > 0 && std::has_single_bit(static_cast<uint64_t>(policy.horizon)));
+        smoothing = policy;
+        size_t sz = policy.window > 0 ? static_cast<size_t>(policy.horizon) : 0;
+        load.observed.assign(sz, 0);
+        load.planned.assign(sz, 0);
+        load.synced = current;
+    }
+    void reset_wakeup_stats() noexcept { wakeup_stats_ = WakeupStats{}; }
 
     // 清空所有事件
     void clear() noexcept {
@@ -472,8 +2497,14 @@ public:
     }
 
     // 暂停/恢复
-    void pause() noexcept { paused = true; }
-    void resume() {
+    void pause() noexcept
+        requires(Traits.pause)
+    {
+        paused = true;
+    }
+    void resume()
+        requires(Traits.pause)
+    {
         paused = false;
         tick(paused_time_); // 这里应该还会保持 ALL / LATEST 属性
         paused_time_ = 0;
@@ -482,12 +2513,23 @@ public:
     size_t _fire_count() const noexcept { return fire_count; }
     size_t _fl_size() const noexcept { return fl.size(); }
     size_t _pq_size() const noexcept { return pq.size(); }
-    void _assert_eid(EventID eid) {
+    size_t _pq_heap_size() const noexcept { return pq.heap_size(); }
+    size_t _pq_overflow_size() const noexcept {
+        if constexpr (Traits.tier_horizon > 0) return pq.overflow_size();
+        else return 0;
+    }
+    size_t _pq_sorted_size() const noexcept {
+        if constexpr (Traits.batch_run) return pq.sorted_size();
+        else return 0;
+    }
+    size_t _capacity() const noexcept { return events.size(); }
+    Alloc get_allocator() const noexcept { return alloc; }
+    void _assert_eid(EventID eid) const noexcept {
         assert(eid.is_valid());
         assert(is_alive(eid));
     }
     std::ostringstream _top_info() const noexcept {
-        EventID top = pq.top();
+        const Node &top = pq.top();
         const Event &e = events[top.index];
         std::ostringstream oss;
         oss << "top event idx:       " << top.index << std::endl;
@@ -503,7 +2545,7 @@ public:
 
     void set_interval(EventID eid, TimeMs new_interval) noexcept {
         _assert_eid(eid);
-        Desc &d = events[eid.index].desc;
+        Desc &d = ev(eid.index).desc;
         assert(d.type == EventType::Repeat);
         assert(new_interval > 0);
         d.interval_ms = new_interval;
@@ -511,55 +2553,169 @@ public:
 
     void set_type(EventID eid, EventType new_type) noexcept {
         _assert_eid(eid);
-        events[eid.index].desc.type = new_type;
+        ev(eid.index).desc.type = new_type;
+    }
+
+    void set_exp_policy(EventID eid, ExceptionPolicy new_policy) noexcept
+        requires(Traits.exceptions)
+    {
+        _assert_eid(eid);
+        ev(eid.index).desc.ep = new_policy;
     }
 
-    void set_exp_policy(EventID eid, ExceptionPolicy new_policy) noexcept {
+    // 优先级是排序键的一部分，活跃事件需要重新入堆
+    void set_priority(EventID eid, Priority new_pri)
+        requires(Traits.priorities)
+    {
         _assert_eid(eid);
-        events[eid.index].desc.ep = new_policy;
+        new_pri = fit_priority(new_pri);
+        if (events[eid.index].desc.pri == new_pri) return;
+        Event &e = ev(eid.index);
+        e.desc.pri = new_pri;
+        if (e.status != EventStatus::Alive || eid.index == firing) return;
+        push_event(eid.index);
+        settle_top();
     }
 
-    void set_priority(EventID eid, EventPriority new_pri) noexcept {
+    void set_catchup(EventID eid, CatchUp new_cu) noexcept
+        requires(Traits.catchup)
+    {
         _assert_eid(eid);
-        events[eid.index].desc.pri = new_pri;
+        ev(eid.index).desc.cu = new_cu;
+    }
+
+    // 不能切换到 Calendar 或从 Calendar 切换出来，日历事件用 schedule_calendar 调度
+    void set_repeat_mode(EventID eid, RepeatMode new_mode) noexcept {
+        _assert_eid(eid);
+        assert((ev(eid.index).desc.repeat == RepeatMode::Calendar) == (new_mode == RepeatMode::Calendar));
+        ev(eid.index).desc.repeat = new_mode;
+    }
+
+    // 测量 FixedDelay 回调执行时间的时钟，单位与 tick 的 delta 相同（例如宿主的单调时钟 ms）。未设置时 FixedDelay 从
+    // 回调开始时的 now() 计时
+    void set_run_clock(std::function<TimeMs()> clock) { run_clock = std::move(clock); }
+
+    void set_slack(EventID eid, TimeMs new_slack) noexcept
+        requires(Traits.slack)
+    {
+        _assert_eid(eid);
+        assert(new_slack >= 0);
+        ev(eid.index).desc.slack_ms = new_slack;
+    }
+
+    // 之后调度的事件默认使用的 slack
+    void set_default_slack(TimeMs slack_ms) noexcept
+        requires(Traits.slack)
+    {
+        assert(slack_ms >= 0);
+        default_slack = slack_ms;
     }
 
-    void set_catchup(EventID eid, CatchUp new_cu) noexcept {
+    void set_jitter(EventID eid, Jitter new_jitter) noexcept
+        requires(Traits.jitter)
+    {
         _assert_eid(eid);
-        events[eid.index].desc.cu = new_cu;
+        assert(new_jitter.max_ms >= 0 && new_jitter.mean_ms >= 0);
+        ev(eid.index).desc.jitter = new_jitter;
     }
 
-    // === 以下接口会修改事件顺序，通过更新 gen 把原来的事件“标记”为旧事件
+    // 之后调度的事件默认使用的 jitter
+    void set_default_jitter(Jitter jitter) noexcept
+        requires(Traits.jitter)
+    {
+        assert(jitter.max_ms >= 0 && jitter.mean_ms >= 0);
+        default_jitter = jitter;
+    }
+
+    // 设置 jitter 使用的随机数种子，相同的种子和操作序列得到相同的触发时刻
+    void seed_jitter(uint64_t seed) noexcept
+        requires(Traits.jitter)
+    {
+        jitter_rng = seed;
+    }
+
+    // === 以下接口会修改事件顺序，事件以新的节点重新入堆，原来的节点通过 stamp “标记”为旧节点，EventID 不变
 
     // 可以传入负数
     void delay(EventID eid, TimeMs ms) noexcept {
-        Event &e = events[eid.index];
-        set_next_fire(eid, e.next_fire + ms);
+        const Event &e = events[eid.index];
+        if (e.status == EventStatus::Paused) ev(eid.index).paused_left += ms;
+        else set_next_fire(eid, e.next_fire + ms);
     }
 
     void set_next_fire(EventID eid, TimeMs next_fire) noexcept {
         _assert_eid(eid);
-        Event &e = events[eid.index];
+        const Event &e = events[eid.index];
+        if (e.status == EventStatus::Paused) {
+            ev(eid.index).paused_left = next_fire - current;
+            return;
+        }
         if (e.next_fire == next_fire) return;
-        // 只有 ticking 且提早事件发生时间到 current 之前的操作才有必要进入 delay ops
-        if (ticking && next_fire <= current) add_delay(eid, next_fire);
-        else default_set_next_fire();
+        move_event(eid, next_fire);
     }
 
 private:
+    Alloc alloc;
     Events events;
     PQ pq;
     FL fl;
     Gens gens;
     Ops delay_ops;
+    Groups groups;
+    FL group_fl;
+    Vec<uint8_t> reserved;          // tick 中 clear 时标记已被预定的槽位
+    mutable Vec2<size_t> frontier; // walk_pq 的工作区
+    ES_NO_UNIQUE_ADDRESS Handlers handlers;
+    ES_NO_UNIQUE_ADDRESS Calendars calendars; // 只增不减，CalendarId 是下标
+    ES_NO_UNIQUE_ADDRESS std::conditional_t<Traits.snapshots, Journal, NoJournal> journal;
+    ES_NO_UNIQUE_ADDRESS std::conditional_t<Traits.keyed, KeyIndex, NoKeyIndex> keys;
+    SmoothingPolicy smoothing{};
+    ES_NO_UNIQUE_ADDRESS std::conditional_t<Storage::fixed, NoLoadHistogram, LoadHistogram> load;
     TimeMs current{};
     TimeMs paused_time_{};
+    ES_NO_UNIQUE_ADDRESS Field<Traits.slack, TimeMs{}> default_slack{};
+    Jitter default_jitter{};
+    uint64_t jitter_rng = 0; // jitter 的 PRNG 状态
+    WakeupStats wakeup_stats_{};
+    CompactPolicy compact_policy{};
+    GcPolicy gc_policy{};
+    GcStats gc_stats_{}; // 只使用 sweeps / collected，其余字段在 gc_stats() 中计算
+    std::function<void(EventID, EventID)> compact_hook;
+    std::function<TimeMs()> run_clock;
+    TimeMs run_ms{}; // 刚触发的 FixedDelay 回调的执行时间
     size_t alive{};
-    size_t cancelled{};
+    size_t cancelled{};   // 已取消但节点仍在 pq 中的事件
+    size_t stale_nodes{}; // pq 中的旧节点
+    size_t gc_cursor{};   // 增量清理在 pq 中的位置
     size_t fire_count{};
+    uint64_t next_seq{}; // 下一个调度序号，clear 时归零
     uint32_t pending_clear{}; // delay ops 中未执行的 clear，用于防止 gen 漂移
+    uint32_t firing = npos;   // 正在执行回调的事件槽位
+    uint32_t gen_floor{};     // 新槽位的起始 gen，compact 之后抬高
+    bool auto_compact = false;
+    bool gc_running = false;
     bool paused = false;
     bool ticking = false;
 };
 
+template <typename Callback = DefaultCallback, SchedulerTraits Traits = SchedulerTraits{},
+          typename Alloc = std::allocator<std::byte>>
+using EventScheduler = BasicEventScheduler<Callback, Traits, DynamicStorage<Alloc>>;
+
+// 写时复制：fork() 只共享内部容器的块，适合每帧拷贝出大量推演分支。ChunkSize 是每块的元素个数
+template <typename Callback = DefaultCallback, SchedulerTraits Traits = SchedulerTraits{}, size_t ChunkSize = 256,
+          typename Alloc = std::allocator<std::byte>>
+using CowEventScheduler = BasicEventScheduler<Callback, Traits, CowStorage<ChunkSize, Alloc>>;
+
+// 最多同时容纳 N 个事件，不分配内存。要做到完全不分配，Callback 本身也不能分配，例如使用函数指针
+template <typename Callback, size_t N, SchedulerTraits Traits = SchedulerTraits{}>
+using StaticEventScheduler = BasicEventScheduler<Callback, Traits, InlineStorage<N>>;
+
+namespace pmr {
+
+template <typename Callback = DefaultCallback, SchedulerTraits Traits = SchedulerTraits{}>
+using EventScheduler = es::EventScheduler<Callback, Traits, std::pmr::polymorphic_allocator<std::byte>>;
+
+} // namespace pmr
+
 } // namespace es
\ No newline at end of file
@@ -0,0 +1,407 @@
+// storage.hpp
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace es {
+
+// 容量固定的 vector，元素存放在对象内部，永远不会分配内存。超出容量属于调用方的错误
+template <typename T, size_t N> class InlineVector {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T &;
+    using const_reference = const T &;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    InlineVector() noexcept = default;
+    // 与分配器版本的容器保持相同的构造方式，分配器被忽略
+    template <typename A> explicit InlineVector(const A &) noexcept {}
+    template <typename A> InlineVector(size_t count, const T &v, const A &) { assign(count, v); }
+    InlineVector(const InlineVector &o) {
+        for (const T &v : o) emplace_back(v);
+    }
+    InlineVector(InlineVector &&o) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        for (T &v : o) emplace_back(std::move(v));
+    }
+    InlineVector &operator=(const InlineVector &o) {
+        if (this == &o) return *this;
+        clear();
+        for (const T &v : o) emplace_back(v);
+        return *this;
+    }
+    InlineVector &operator=(InlineVector &&o) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this == &o) return *this;
+        clear();
+        for (T &v : o) emplace_back(std::move(v));
+        return *this;
+    }
+    ~InlineVector() { clear(); }
+
+    static constexpr size_t capacity() noexcept { return N; }
+    size_t size() const noexcept { return n; }
+    bool empty() const noexcept { return n == 0; }
+    bool full() const noexcept { return n == N; }
+
+    T *data() noexcept { return std::launder(reinterpret_cast<T *>(buf)); }
+    const T *data() const noexcept { return std::launder(reinterpret_cast<const T *>(buf)); }
+    iterator begin() noexcept { return data(); }
+    iterator end() noexcept { return data() + n; }
+    const_iterator begin() const noexcept { return data(); }
+    const_iterator end() const noexcept { return data() + n; }
+
+    T &operator[](size_t i) noexcept {
+        assert(i < n);
+        return data()[i];
+    }
+    const T &operator[](size_t i) const noexcept {
+        assert(i < n);
+        return data()[i];
+    }
+    T &front() noexcept { return (*this)[0]; }
+    const T &front() const noexcept { return (*this)[0]; }
+    T &back() noexcept { return (*this)[n - 1]; }
+    const T &back() const noexcept { return (*this)[n - 1]; }
+
+    template <typename... Args> T &emplace_back(Args &&...args) {
+        assert(n < N);
+        T *p = ::new (static_cast<void *>(data() + n)) T(std::forward<Args>(args)...);
+        ++n;
+        return *p;
+    }
+    void push_back(const T &v) { emplace_back(v); }
+    void push_back(T &&v) { emplace_back(std::move(v)); }
+    void pop_back() noexcept {
+        assert(n > 0);
+        --n;
+        std::destroy_at(data() + n);
+    }
+    void clear() noexcept {
+        while (n > 0) pop_back();
+    }
+    void reserve(size_t c) const noexcept {
+        assert(c <= N);
+        (void)c;
+    }
+    void shrink_to_fit() const noexcept {}
+    // 只支持缩小或者用默认值扩大
+    void resize(size_t c) {
+        assert(c <= N);
+        while (n > c) pop_back();
+        while (n < c) emplace_back();
+    }
+    void assign(size_t c, const T &v) {
+        assert(c <= N);
+        clear();
+        while (n < c) emplace_back(v);
+    }
+    void swap(InlineVector &o) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        InlineVector tmp(std::move(o));
+        o = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    alignas(T) std::byte buf[sizeof(T) * N];
+    size_t n = 0;
+};
+
+// 写时复制的分块 vector：元素存放在 ChunkSize 个一块的块中，块和块表都带引用计数。拷贝只共享块表，O(1)；非 const 访问
+// 先把块表和被访问的块变为独占（被共享时复制一份），所以修改只复制写到的块。push_back 不搬动已有元素，引用保持有效，与
+// deque 相同。块记录分配时的分配器，由最后一个持有者释放。块表尾部可以有空块，反复 push / pop 时不会反复分配
+template <typename T, typename Alloc, size_t ChunkSize> class CowVector {
+    static_assert(ChunkSize > 0 && std::has_single_bit(ChunkSize), "ChunkSize 必须是 2 的幂");
+    static constexpr int shift = std::countr_zero(ChunkSize);
+    static constexpr size_t mask = ChunkSize - 1;
+
+    struct Chunk {
+        explicit Chunk(const Alloc &a) : alloc(a) {}
+        T *data() noexcept { return std::launder(reinterpret_cast<T *>(buf)); }
+
+        Alloc alloc;
+        std::atomic<uint32_t> refs{1};
+        uint32_t n = 0; // 已构造的元素个数
+        alignas(T) std::byte buf[sizeof(T) * ChunkSize];
+    };
+    template <typename U> using AllocOf = typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+    struct Table {
+        explicit Table(const Alloc &a) : chunks(AllocOf<Chunk *>(a)) {}
+
+        std::atomic<uint32_t> refs{1};
+        std::vector<Chunk *, AllocOf<Chunk *>> chunks;
+    };
+
+    template <bool Const> class Iter {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T *, T *>;
+        using reference = std::conditional_t<Const, const T &, T &>;
+
+        Iter() noexcept = default;
+        Iter(Chunk *const *c, size_t i) noexcept : chunks(c), idx(i) {}
+        operator Iter<true>() const noexcept { return {chunks, idx}; }
+
+        reference operator*() const noexcept { return chunks[idx >> shift]->data()[idx & mask]; }
+        pointer operator->() const noexcept { return &**this; }
+        reference operator[](difference_type k) const noexcept { return *(*this + k); }
+        Iter &operator++() noexcept {
+            ++idx;
+            return *this;
+        }
+        Iter operator++(int) noexcept { return Iter(chunks, idx++); }
+        Iter &operator--() noexcept {
+            --idx;
+            return *this;
+        }
+        Iter operator--(int) noexcept { return Iter(chunks, idx--); }
+        Iter &operator+=(difference_type k) noexcept {
+            idx = static_cast<size_t>(static_cast<difference_type>(idx) + k);
+            return *this;
+        }
+        Iter &operator-=(difference_type k) noexcept { return *this += -k; }
+        friend Iter operator+(Iter it, difference_type k) noexcept { return it += k; }
+        friend Iter operator+(difference_type k, Iter it) noexcept { return it += k; }
+        friend Iter operator-(Iter it, difference_type k) noexcept { return it -= k; }
+        friend difference_type operator-(const Iter &l, const Iter &r) noexcept {
+            return static_cast<difference_type>(l.idx) - static_cast<difference_type>(r.idx);
+        }
+        friend bool operator==(const Iter &l, const Iter &r) noexcept { return l.idx == r.idx; }
+        friend std::strong_ordering operator<=>(const Iter &l, const Iter &r) noexcept { return l.idx <=> r.idx; }
+
+    private:
+        Chunk *const *chunks = nullptr;
+        size_t idx = 0;
+    };
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T &;
+    using const_reference = const T &;
+    using iterator = Iter<false>;
+    using const_iterator = Iter<true>;
+
+    CowVector() = default;
+    explicit CowVector(const Alloc &a) noexcept : alloc(a) {}
+    CowVector(size_t count, const T &v, const Alloc &a) : alloc(a) { assign(count, v); }
+    CowVector(const CowVector &o) noexcept : alloc(o.alloc), table(o.table), n(o.n) {
+        if (table) table->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    CowVector(CowVector &&o) noexcept
+        : alloc(o.alloc), table(std::exchange(o.table, nullptr)), n(std::exchange(o.n, 0)) {}
+    // 赋值只交换内容，分配器保持不变：块自己记录了分配器，共享不同分配器的块也可以正确释放
+    CowVector &operator=(const CowVector &o) noexcept {
+        CowVector tmp(o);
+        swap(tmp);
+        return *this;
+    }
+    CowVector &operator=(CowVector &&o) noexcept {
+        CowVector tmp(std::move(o));
+        swap(tmp);
+        return *this;
+    }
+    ~CowVector() { release(table); }
+
+    size_t size() const noexcept { return n; }
+    bool empty() const noexcept { return n == 0; }
+
+    T &operator[](size_t i) {
+        assert(i < n);
+        return own_chunk(i >> shift).data()[i & mask];
+    }
+    const T &operator[](size_t i) const noexcept {
+        assert(i < n);
+        return table->chunks[i >> shift]->data()[i & mask];
+    }
+    T &front() { return (*this)[0]; }
+    const T &front() const noexcept { return (*this)[0]; }
+    T &back() { return (*this)[n - 1]; }
+    const T &back() const noexcept { return (*this)[n - 1]; }
+
+    // 非 const 迭代器可以写任意元素，先让所有块独占
+    iterator begin() { return iterator(own_all(), 0); }
+    iterator end() { return iterator(own_all(), n); }
+    const_iterator begin() const noexcept { return const_iterator(chunk_ptrs(), 0); }
+    const_iterator end() const noexcept { return const_iterator(chunk_ptrs(), n); }
+
+    template <typename... Args> T &emplace_back(Args &&...args) {
+        if (!table) table = new_table(alloc);
+        size_t ci = n >> shift;
+        Table &t = own_table();
+        if (ci == t.chunks.size()) {
+            Chunk *c = new_chunk(alloc);
+            try {
+                t.chunks.push_back(c);
+            } catch (...) {
+                unref(c);
+                throw;
+            }
+        }
+        Chunk &c = own_chunk(ci);
+        T *p = ::new (static_cast<void *>(c.data() + (n & mask))) T(std::forward<Args>(args)...);
+        ++c.n;
+        ++n;
+        return *p;
+    }
+    void push_back(const T &v) { emplace_back(v); }
+    void push_back(T &&v) { emplace_back(std::move(v)); }
+    void pop_back() {
+        assert(n > 0);
+        Chunk &c = own_chunk((n - 1) >> shift);
+        --n;
+        --c.n;
+        std::destroy_at(c.data() + c.n);
+    }
+
+    // 被共享时直接放弃块表，O(1)；独占时保留独占的空块供之后使用
+    void clear() noexcept {
+        if (!table) return;
+        n = 0;
+        if (table->refs.load(std::memory_order_acquire) != 1) {
+            release(std::exchange(table, nullptr));
+            return;
+        }
+        auto &cs = table->chunks;
+        size_t w = 0;
+        for (Chunk *c : cs) {
+            if (c->refs.load(std::memory_order_acquire) != 1) {
+                unref(c);
+                continue;
+            }
+            std::destroy(c->data(), c->data() + c->n);
+            c->n = 0;
+            cs[w++] = c;
+        }
+        cs.resize(w);
+    }
+    void reserve(size_t) const noexcept {}
+    void shrink_to_fit() const noexcept {}
+    void resize(size_t c) {
+        while (n > c) pop_back();
+        while (n < c) emplace_back();
+    }
+    void assign(size_t c, const T &v) {
+        clear();
+        while (n < c) emplace_back(v);
+    }
+    void swap(CowVector &o) noexcept {
+        std::swap(table, o.table);
+        std::swap(n, o.n);
+    }
+
+private:
+    static Table *new_table(const Alloc &a) {
+        AllocOf<Table> ta(a);
+        Table *t = std::allocator_traits<AllocOf<Table>>::allocate(ta, 1);
+        return ::new (static_cast<void *>(t)) Table(a);
+    }
+    static Chunk *new_chunk(const Alloc &a) {
+        AllocOf<Chunk> ca(a);
+        Chunk *c = std::allocator_traits<AllocOf<Chunk>>::allocate(ca, 1);
+        return ::new (static_cast<void *>(c)) Chunk(a);
+    }
+    static void unref(Chunk *c) noexcept {
+        if (c->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        std::destroy(c->data(), c->data() + c->n);
+        AllocOf<Chunk> ca(c->alloc);
+        c->~Chunk();
+        std::allocator_traits<AllocOf<Chunk>>::deallocate(ca, c, 1);
+    }
+    static void release(Table *t) noexcept {
+        if (!t || t->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        for (Chunk *c : t->chunks) unref(c);
+        AllocOf<Table> ta(t->chunks.get_allocator());
+        t->~Table();
+        std::allocator_traits<AllocOf<Table>>::deallocate(ta, t, 1);
+    }
+
+    Table &own_table() {
+        if (table->refs.load(std::memory_order_acquire) != 1) {
+            Table *t = new_table(alloc);
+            try {
+                t->chunks.assign(table->chunks.begin(), table->chunks.end());
+            } catch (...) {
+                release(t);
+                throw;
+            }
+            for (Chunk *c : t->chunks) c->refs.fetch_add(1, std::memory_order_relaxed);
+            release(std::exchange(table, t));
+        }
+        return *table;
+    }
+
+    Chunk &own_chunk(size_t ci) {
+        Chunk *&p = own_table().chunks[ci];
+        if (p->refs.load(std::memory_order_acquire) != 1) {
+            Chunk *c = new_chunk(alloc);
+            try {
+                for (; c->n < p->n; ++c->n) ::new (static_cast<void *>(c->data() + c->n)) T(p->data()[c->n]);
+            } catch (...) {
+                unref(c);
+                throw;
+            }
+            unref(std::exchange(p, c));
+        }
+        return *p;
+    }
+
+    Chunk *const *own_all() {
+        if (!table) return nullptr;
+        for (size_t ci = 0; ci < ((n + mask) >> shift); ++ci) own_chunk(ci);
+        return table->chunks.data();
+    }
+    Chunk *const *chunk_ptrs() const noexcept { return table ? table->chunks.data() : nullptr; }
+
+    Alloc alloc{};
+    Table *table = nullptr;
+    size_t n = 0;
+};
+
+// 存储策略：决定调度器内部容器的类型。Scale 是相对于事件容量的倍数，只对固定容量的存储有意义
+
+// 按需增长，所有容器使用 Alloc（rebind 之后）
+template <typename Alloc = std::allocator<std::byte>> struct DynamicStorage {
+    static constexpr bool fixed = false;
+    static constexpr bool cow = false;
+    using allocator_type = Alloc;
+    template <typename T> using AllocOf = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    template <typename T> using Slots = std::deque<T, AllocOf<T>>; // 防止扩容 Callback 搬家
+    template <typename T, size_t Scale = 1> using Vec = std::vector<T, AllocOf<T>>;
+};
+
+// 最多 N 个事件，所有容器都在对象内部，不会分配内存
+template <size_t N> struct InlineStorage {
+    static_assert(N > 0 && N < (size_t{1} << 31), "容量必须在 (0, 2^31) 之内");
+    static constexpr bool fixed = true;
+    static constexpr bool cow = false;
+    static constexpr size_t capacity = N;
+    using allocator_type = std::allocator<std::byte>;
+    template <typename T> using Slots = InlineVector<T, N>;
+    template <typename T, size_t Scale = 1> using Vec = InlineVector<T, N * Scale>;
+};
+
+// 按需增长，所有容器都是 CowVector：拷贝调度器时每个容器只共享块表，与事件数无关（非容器成员照常拷贝），之后各自修改时
+// 才复制块表和写到的块
+template <size_t ChunkSize = 256, typename Alloc = std::allocator<std::byte>> struct CowStorage {
+    static constexpr bool fixed = false;
+    static constexpr bool cow = true;
+    using allocator_type = Alloc;
+    template <typename T> using Slots = CowVector<T, Alloc, ChunkSize>;
+    template <typename T, size_t Scale = 1> using Vec = CowVector<T, Alloc, ChunkSize>;
+};
+
+} // namespace es